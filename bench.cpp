@@ -0,0 +1,1010 @@
+#include "server_utils.h"
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <regex>
+
+// Benchmarks of the dormitory reservation system.
+// Usage: ./bench <case> [options]; run ./bench without arguments to list the cases.
+
+
+/**
+ * Seconds elapsed since a given time point
+ * @param start time point
+ * @return elapsed seconds
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/**
+ * Split a comma separated list of positive numbers
+ * @param list input string, e.g. "1,2,4"
+ * @return the numbers
+ */
+static std::vector<int> parseList(const std::string& list) {
+    std::vector<int> res;
+    std::istringstream iss(list);
+    std::string item;
+    while (getline(iss, item, ',')) {
+        if (atoi(item.c_str()) > 0) {
+            res.push_back(atoi(item.c_str()));
+        }
+    }
+    return res;
+}
+
+
+/**
+ * Keep opening and closing TCP connections to the main server until the deadline
+ * @param serverInfo address of the main server
+ * @param deadline when to stop
+ * @param count to accumulate the number of completed connections
+ */
+static void connectLoop(const struct addrinfo *serverInfo, std::chrono::steady_clock::time_point deadline,
+                        std::atomic<long>& count) {
+    struct linger noLinger = {1, 0}; // reset on close, so the client side does not pile up TIME_WAIT sockets
+    long done = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        int sockfd = socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol);
+        if (sockfd == -1) {
+            perror("bench: socket");
+            break;
+        }
+        setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &noLinger, sizeof noLinger);
+        if (connect(sockfd, serverInfo->ai_addr, serverInfo->ai_addrlen) == 0) {
+            done++;
+        }
+        close(sockfd);
+    }
+    count += done;
+}
+
+
+/**
+ * accept: start ./serverM with each given number of reactor threads and measure connections/sec
+ * from a fixed pool of connecting threads.
+ * Options: -s thread counts to sweep (default 1,2,4,...,cores), -c connecting threads, -d seconds per run
+ */
+static int benchAccept(int argc, char *argv[]) {
+    int numCores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> sweep;
+    for (int n = 1; n < numCores; n *= 2) {
+        sweep.push_back(n);
+    }
+    sweep.push_back(numCores);
+    int numClients = numCores * 2;
+    double duration = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:d:")) != -1) {
+        if (opt == 's') {
+            sweep = parseList(optarg);
+        } else if (opt == 'c') {
+            numClients = std::max(1, atoi(optarg));
+        } else if (opt == 'd') {
+            duration = atof(optarg);
+        } else {
+            return 1;
+        }
+    }
+
+    struct addrinfo hints, *serverInfo;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET; // use IPv4
+    hints.ai_socktype = SOCK_STREAM; // use TCP
+    if (getaddrinfo(LOCAL_HOST, PORT_SM_TCP, &hints, &serverInfo) != 0) {
+        perror("bench: getaddrinfo");
+        return 1;
+    }
+
+    std::cout << "reactors,connections_per_sec,speedup" << std::endl;
+    double baseline = 0;
+    for (int numReactors : sweep) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("bench: fork");
+            return 1;
+        }
+        if (pid == 0) { // the main server under test, with its on-screen messages discarded
+            freopen("/dev/null", "w", stdout);
+            std::string threads = std::to_string(numReactors);
+            execl("./serverM", "serverM", "-t", threads.c_str(), (char *)nullptr);
+            perror("bench: exec ./serverM");
+            _exit(1);
+        }
+        usleep(300 * 1000); // let the main server bind its sockets
+
+        std::atomic<long> count(0);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(duration));
+        for (int i = 0; i < numClients; i++) {
+            threads.emplace_back(connectLoop, serverInfo, deadline, std::ref(count));
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+        double rate = count / secondsSince(start);
+
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+
+        if (baseline == 0) {
+            baseline = rate;
+        }
+        std::cout << numReactors << "," << (long)rate << "," << rate / baseline << std::endl;
+    }
+    freeaddrinfo(serverInfo);
+    return 0;
+}
+
+
+/**
+ * wire: encode and then decode a stream of CH requests in the text and in the binary protocol.
+ * Options: -n number of messages
+ */
+static int benchWire(int argc, char *argv[]) {
+    long numMessages = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            numMessages = std::max(1L, atol(optarg));
+        } else {
+            return 1;
+        }
+    }
+    const std::string roomcodes[] = {"S143", "S233", "D136", "D219", "U283", "U407"};
+
+    // text protocol
+    auto start = std::chrono::steady_clock::now();
+    std::string text;
+    for (long i = 0; i < numMessages; i++) {
+        text += std::string(MSG_CHECK_REQUEST) + "\n" + std::to_string(i) + "\n" + roomcodes[i % 6] + "\n";
+    }
+    double textEncode = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    size_t pos = 0, checksum = 0;
+    std::vector<std::string> fields;
+    while (takeMessage(text, pos, fields)) {
+        checksum += fields[2].length();
+    }
+    double textDecode = secondsSince(start);
+
+    // binary protocol
+    start = std::chrono::steady_clock::now();
+    std::string binary;
+    for (long i = 0; i < numMessages; i++) {
+        encodeRoomRequest(binary, MSG_CHECK_REQUEST, i, roomcodes[i % 6]);
+    }
+    double binaryEncode = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    struct BinaryFrame frame;
+    long taken;
+    pos = 0;
+    while ((taken = decodeFrame(binary.data() + pos, binary.length() - pos, frame)) > 0) {
+        pos += taken;
+        checksum -= roomcodeOf(frame.payload).length();
+    }
+    double binaryDecode = secondsSince(start);
+    if (checksum != 0) {
+        std::cerr << "bench: text and binary decoding disagree" << std::endl;
+        return 1;
+    }
+
+    std::cout << "protocol,bytes_per_msg,encode_ns_per_msg,decode_ns_per_msg" << std::endl;
+    std::cout << "text," << (double)text.length() / numMessages << "," << textEncode * 1e9 / numMessages << ","
+        << textDecode * 1e9 / numMessages << std::endl;
+    std::cout << "binary," << (double)binary.length() / numMessages << "," << binaryEncode * 1e9 / numMessages << ","
+        << binaryDecode * 1e9 / numMessages << std::endl;
+    return 0;
+}
+
+
+// regex_search with "([^,]*),(.*)", as getLoginInfoFromLine used to do
+static bool regexLoginInfo(const std::string& line, std::string& username, std::string& password, const std::regex& re) {
+    std::smatch match;
+    if (!regex_search(line, match, re)) {
+        return false;
+    }
+    username = match[1].str();
+    password = match[2].str();
+    return true;
+}
+
+
+// regex_search with "([^,]+),\s*(\d+)", as getDataFromLine used to do; stoi overflow counts as no match
+static bool regexRoomEntry(const std::string& line, std::string& roomcode, int& numAvailable, const std::regex& re) {
+    std::smatch match;
+    if (!regex_search(line, match, re)) {
+        return false;
+    }
+    try {
+        numAvailable = stoi(match[2].str());
+    } catch (const std::out_of_range&) {
+        return false;
+    }
+    roomcode = match[1].str();
+    return true;
+}
+
+
+/**
+ * A random line made of the characters the regular expressions care about, with long runs now and then
+ * to hit the {5,50} bounds
+ * @param rng random generator
+ * @return the line
+ */
+static std::string randomLine(std::mt19937& rng) {
+    static const char alphabet[] = "abcxyzSDU019,,,,  \t\r\n\v\f";
+    std::string line;
+    int length = rng() % 130;
+    while ((int)line.length() < length) {
+        char c = alphabet[rng() % (sizeof alphabet - 1)];
+        line.append(rng() % 8 == 0 ? rng() % 60 : 1, c);
+    }
+    return line;
+}
+
+
+/**
+ * parse: check the hand-written line scanners against the regular expressions they replace on random lines,
+ * then time both on typical lines.
+ * Options: -f number of random lines to check, -n number of timed iterations
+ */
+static int benchParse(int argc, char *argv[]) {
+    long numFuzz = 20000, numIterations = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:")) != -1) {
+        if (opt == 'f') {
+            numFuzz = std::max(0L, atol(optarg));
+        } else if (opt == 'n') {
+            numIterations = std::max(1L, atol(optarg));
+        } else {
+            return 1;
+        }
+    }
+
+    // differential check
+    std::regex loginRe("([^,]*),(.*)"), roomRe("([^,]+),\\s*(\\d+)"), memberRe("([^,]{5,50}),\\s(.{5,50})");
+    std::regex usernameRe("[a-z]{5,50}"), passwordRe(".{5,50}");
+    std::mt19937 rng(450);
+    long mismatches = 0;
+    for (long i = 0; i < numFuzz; i++) {
+        std::string line = randomLine(rng);
+        std::string a, b;
+        std::string_view x, y;
+        int m = 0, n = 0;
+        std::smatch match;
+
+        bool expected = regexLoginInfo(line, a, b, loginRe);
+        bool mismatch = expected != scanLoginInfo(line, x, y) || (expected && (a != x || b != y));
+        expected = regexRoomEntry(line, a, m, roomRe);
+        mismatch |= expected != scanRoomEntry(line, x, n) || (expected && (a != x || m != n));
+        expected = regex_search(line, match, memberRe);
+        mismatch |= expected != scanMemberEntry(line, x, y) || (expected && (match[1].str() != x || match[2].str() != y));
+        mismatch |= regex_match(line, usernameRe) != isValidUsername(line);
+        mismatch |= regex_match(line, passwordRe) != isValidPassword(line);
+        if (mismatch && mismatches++ < 10) {
+            std::cerr << "mismatch on line: \"" << line << "\"" << std::endl;
+        }
+    }
+    std::cout << "random lines checked: " << numFuzz << ", mismatches: " << mismatches << std::endl;
+
+    // timing: the old code built its std::regex on every call
+    const std::string roomLine = "S233, 6", memberLine = "mdphv, VRGlgv625";
+    long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < numIterations; i++) {
+        std::string roomcode, username, password;
+        int numAvailable = 0;
+        regexRoomEntry(roomLine, roomcode, numAvailable, std::regex("([^,]+),\\s*(\\d+)"));
+        regexLoginInfo(memberLine, username, password, std::regex("([^,]*),(.*)"));
+        checksum += numAvailable + password.length();
+    }
+    double regexTime = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < numIterations; i++) {
+        std::string_view roomcode, username, password;
+        int numAvailable = 0;
+        scanRoomEntry(roomLine, roomcode, numAvailable);
+        scanLoginInfo(memberLine, username, password);
+        checksum -= numAvailable + password.length();
+    }
+    double scanTime = secondsSince(start);
+
+    std::cout << "parser,ns_per_room_and_login_line" << std::endl;
+    std::cout << "regex," << regexTime * 1e9 / numIterations << std::endl;
+    std::cout << "scanner," << scanTime * 1e9 / numIterations << std::endl;
+    return mismatches == 0 && checksum == 0 ? 0 : 1;
+}
+
+
+/**
+ * load: generate a room inventory file and time loading it line by line (std::ifstream + getline, as the
+ * backend servers used to) against BackendServer::initDataFromFile, and against mapping it converted to a room table.
+ * Options: -n number of room layouts, -f path of the generated file
+ */
+static int benchLoad(int argc, char *argv[]) {
+    long numRooms = 2000000;
+    std::string file = "/tmp/bench_rooms.txt";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:")) != -1) {
+        if (opt == 'n') {
+            numRooms = std::max(1L, atol(optarg));
+        } else if (opt == 'f') {
+            file = optarg;
+        } else {
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(file.c_str(), "w");
+    if (out == nullptr) {
+        perror("bench: fopen");
+        return 1;
+    }
+    for (long i = 0; i < numRooms; i++) {
+        fprintf(out, "S%08ld, %ld\n", i, i % 10);
+    }
+    fclose(out);
+
+    auto start = std::chrono::steady_clock::now();
+    std::map<std::string, int> lineByLine;
+    std::ifstream inFile(file);
+    std::string line;
+    std::string_view roomcode;
+    int numAvailable;
+    while (getline(inFile, line)) {
+        if (scanRoomEntry(line, roomcode, numAvailable)) {
+            lineByLine[std::string(roomcode)] = numAvailable;
+        }
+    }
+    double lineTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    BackendServer backend("S", LOCAL_HOST, PORT_SS_UDP);
+    backend.initDataFromFile(file);
+    double bulkTime = secondsSince(start);
+    unlink(file.c_str());
+
+    std::string table = tableFileOf(file);
+    if (!backend.writeDataToTable(table)) {
+        return 1;
+    }
+    start = std::chrono::steady_clock::now();
+    BackendServer mappedBackend("S", LOCAL_HOST, PORT_SS_UDP);
+    if (!mappedBackend.initDataFromTable(table)) {
+        return 1;
+    }
+    double mappedTime = secondsSince(start);
+    unlink(table.c_str());
+
+    if (backend.numRooms() != lineByLine.size() || mappedBackend.numRooms() != lineByLine.size()) {
+        std::cerr << "bench: loaders disagree on the number of rooms" << std::endl;
+        return 1;
+    }
+    std::cout << "loader,rooms,seconds" << std::endl;
+    std::cout << "line_by_line," << lineByLine.size() << "," << lineTime << std::endl;
+    std::cout << "bulk," << backend.numRooms() << "," << bulkTime << std::endl;
+    std::cout << "mapped_table," << mappedBackend.numRooms() << "," << mappedTime << std::endl;
+    return 0;
+}
+
+
+/**
+ * lookup: time looking up room layouts in a RoomIndex against a std::map<std::string, int> (the room table
+ * the servers used to keep), over the same random mix of known and unknown room layout codes.
+ * Options: -n number of room layouts, -q number of lookups, -m percentage of lookups of unknown codes
+ */
+static int benchLookup(int argc, char *argv[]) {
+    long numRooms = 1000000;
+    long numQueries = 2000000;
+    int missPercent = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:q:m:")) != -1) {
+        if (opt == 'n') {
+            numRooms = std::max(1L, atol(optarg));
+        } else if (opt == 'q') {
+            numQueries = std::max(1L, atol(optarg));
+        } else if (opt == 'm') {
+            missPercent = std::min(100, std::max(0, atoi(optarg)));
+        } else {
+            return 1;
+        }
+    }
+
+    const char prefixes[] = "SDU";
+    std::mt19937 rng(450);
+    std::map<std::string, int> map;
+    RoomIndex index;
+    index.reserve(numRooms);
+    for (long i = 0; i < numRooms; i++) {
+        std::string roomcode = prefixes[i % 3] + std::to_string(i);
+        map[roomcode] = i % 10;
+        index.assign(roomcode, i % 10);
+    }
+    std::vector<std::string> queries(numQueries);
+    for (std::string& query : queries) {
+        long i = rng() % numRooms;
+        query = (long)(rng() % 100) < missPercent ? "X" + std::to_string(i) : prefixes[i % 3] + std::to_string(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    long mapSum = 0;
+    for (const std::string& query : queries) {
+        auto it = map.find(query);
+        mapSum += it == map.end() ? -1 : it->second;
+    }
+    double mapTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    long indexSum = 0;
+    for (const std::string& query : queries) {
+        uint32_t id = index.find(query);
+        indexSum += id == ROOM_NOT_FOUND ? -1 : index.count(id);
+    }
+    double indexTime = secondsSince(start);
+
+    if (mapSum != indexSum) {
+        std::cerr << "bench: room tables disagree" << std::endl;
+        return 1;
+    }
+    std::cout << "table,rooms,ns_per_lookup" << std::endl;
+    std::cout << "std_map," << numRooms << "," << mapTime * 1e9 / numQueries << std::endl;
+    std::cout << "room_index," << numRooms << "," << indexTime * 1e9 / numQueries << std::endl;
+    return 0;
+}
+
+
+/**
+ * login: member lookups of tryLogin in the member index against the std::map it replaces, over generated members
+ * (valid encrypted usernames and passwords); the two must agree on every login. Also times wrong passwords that
+ * differ from the right one in the first and in the last character, which the constant-time comparison makes equal.
+ * Options: -n number of members, -q number of logins, -m percentage of unknown usernames, -w percentage of wrong
+ * passwords
+ */
+static int benchLogin(int argc, char *argv[]) {
+    long numMembers = 1000000;
+    long numQueries = 2000000;
+    int missPercent = 10, wrongPercent = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:q:m:w:")) != -1) {
+        if (opt == 'n') {
+            numMembers = std::max(1L, atol(optarg));
+        } else if (opt == 'q') {
+            numQueries = std::max(1L, atol(optarg));
+        } else if (opt == 'm') {
+            missPercent = std::min(100, std::max(0, atoi(optarg)));
+        } else if (opt == 'w') {
+            wrongPercent = std::min(100, std::max(0, atoi(optarg)));
+        } else {
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(450);
+    auto randomWord = [&rng](const char *alphabet, size_t alphabetLen, size_t length) {
+        std::string word;
+        while (word.length() < length) {
+            word += alphabet[rng() % alphabetLen];
+        }
+        return word;
+    };
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    static const char printable[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&*+-.?@_";
+    std::vector<std::pair<std::string, std::string>> members(numMembers);
+    for (long i = 0; i < numMembers; i++) {
+        // a random prefix, then the member number in base 26, keeps usernames unique
+        std::string username = randomWord(letters, 26, 3 + rng() % 10);
+        for (long n = i; n > 0 || username.length() < 5; n /= 26) {
+            username += letters[n % 26];
+        }
+        members[i] = {username, randomWord(printable, sizeof printable - 1, 5 + rng() % 20)};
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::map<std::string, std::string> map;
+    for (const auto& member : members) {
+        map[member.first] = member.second;
+    }
+    double mapBuild = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    MemberIndex index;
+    for (const auto& member : members) {
+        index.add(member.first, member.second);
+    }
+    index.build();
+    double indexBuild = secondsSince(start);
+
+    std::vector<std::pair<std::string, std::string>> queries(numQueries);
+    for (auto& query : queries) {
+        query = members[rng() % numMembers];
+        int kind = rng() % 100;
+        if (kind < missPercent) {
+            query.first += "zz"; // longer than any username with the same member number
+        } else if (kind < missPercent + wrongPercent) {
+            query.second.back() ^= 1;
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    long mapSum = 0;
+    for (const auto& query : queries) {
+        if (map.find(query.first) == map.end()) {
+            mapSum += MEMBER_NOT_FOUND;
+        } else {
+            mapSum += map.at(query.first) == query.second ? MEMBER_MATCH : MEMBER_WRONG_PASSWORD;
+        }
+    }
+    double mapTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    long indexSum = 0;
+    for (const auto& query : queries) {
+        indexSum += index.check(query.first, query.second);
+    }
+    double indexTime = secondsSince(start);
+
+    if (mapSum != indexSum || index.size() != map.size()) {
+        std::cerr << "bench: member tables disagree" << std::endl;
+        return 1;
+    }
+
+    // the same member with a password wrong in its first or in its last character, many times over
+    const auto& probe = *std::max_element(members.begin(), members.end(), [](const auto& a, const auto& b) {
+        return a.second.length() < b.second.length();
+    });
+    double wrongAt[2];
+    for (int last = 0; last < 2; last++) {
+        std::string password = probe.second;
+        password[last ? password.length() - 1 : 0] ^= 1;
+        start = std::chrono::steady_clock::now();
+        long wrong = 0;
+        for (long i = 0; i < numQueries; i++) {
+            wrong += index.check(probe.first, password) == MEMBER_WRONG_PASSWORD;
+        }
+        wrongAt[last] = secondsSince(start) * 1e9 / numQueries;
+        if (wrong != numQueries) {
+            std::cerr << "bench: a wrong password matched" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "table,members,build_ms,ns_per_login" << std::endl;
+    std::cout << "std_map," << numMembers << "," << mapBuild * 1e3 << "," << mapTime * 1e9 / numQueries << std::endl;
+    std::cout << "member_index," << numMembers << "," << indexBuild * 1e3 << "," << indexTime * 1e9 / numQueries
+        << std::endl;
+    std::cout << "wrong_password_ns: first_char " << wrongAt[0] << ", last_char " << wrongAt[1] << " (password of "
+        << probe.second.length() << " chars)" << std::endl;
+    return 0;
+}
+
+
+// per character, as encrypt_offset of the client used to do
+static std::string scalarEncryptOffset(const std::string& input) {
+    std::string encrypted;
+    for (char c : input) {
+        if (isdigit(c)) {
+            encrypted += (c - '0' + 3) % 10 + '0';
+        } else if (isalpha(c)) {
+            char base = isupper(c) ? 'A' : 'a';
+            encrypted += (c - base + 3) % 26 + base;
+        } else {
+            encrypted += c;
+        }
+    }
+    return encrypted;
+}
+
+
+// per character, as decrypt_offset of serverM used to do, unless wrapAround: it did not wrap 0-2, a-c and A-C
+// around (the remainder of a negative number is negative) but turned them into the bytes right before their range
+static std::string scalarDecryptOffset(const std::string& input, bool wrapAround) {
+    int size = wrapAround ? 10 : 0, letters = wrapAround ? 26 : 0;
+    std::string decrypted;
+    for (char c : input) {
+        if (isdigit(c)) {
+            decrypted += (c - '0' - 3 + size) % 10 + '0';
+        } else if (isalpha(c)) {
+            char base = isupper(c) ? 'A' : 'a';
+            decrypted += (c - base - 3 + letters) % 26 + base;
+        } else {
+            decrypted += c;
+        }
+    }
+    return decrypted;
+}
+
+
+/**
+ * cipher: the offset cipher kernels checked exhaustively against the per-character code they replace: every byte
+ * value at every position of strings of 0 to 96 bytes, at every start offset within 32 bytes, in both directions,
+ * and decrypting what was encrypted; then the throughput of each kernel over a buffer of member-file lines.
+ * Options: -n buffer size in MB, -r rounds over the buffer
+ */
+static int benchCipher(int argc, char *argv[]) {
+    long megabytes = 64;
+    int rounds = 5;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        if (opt == 'n') {
+            megabytes = std::max(1L, atol(optarg));
+        } else if (opt == 'r') {
+            rounds = std::max(1, atoi(optarg));
+        } else {
+            return 1;
+        }
+    }
+
+    std::vector<enum OffsetKernel> kernels;
+    for (enum OffsetKernel kernel : {OFFSET_KERNEL_SCALAR, OFFSET_KERNEL_SSE2, OFFSET_KERNEL_AVX2}) {
+        if (offsetKernelSupported(kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+
+    long checked = 0;
+    char buffer[32 + 96];
+    for (size_t len = 0; len <= 96; len++) {
+        for (int first = 0; first < 256; first++) {
+            std::string original(len, 0);
+            for (size_t i = 0; i < len; i++) {
+                original[i] = (char)((first + i) & 0xFF); // every byte value at every position over the 256 firsts
+            }
+            std::string encrypted = scalarEncryptOffset(original), decrypted = scalarDecryptOffset(original, true);
+            for (enum OffsetKernel kernel : kernels) {
+                for (size_t start = 0; start < 32; start += len < 32 ? 1 : 7) {
+                    char *data = buffer + start;
+                    memcpy(data, original.data(), len);
+                    applyOffsetCipherWith(kernel, data, len, false);
+                    bool ok = encrypted.compare(0, len, data, len) == 0;
+                    applyOffsetCipherWith(kernel, data, len, true);
+                    ok = ok && original.compare(0, len, data, len) == 0;
+                    memcpy(data, original.data(), len);
+                    applyOffsetCipherWith(kernel, data, len, true);
+                    ok = ok && decrypted.compare(0, len, data, len) == 0;
+                    if (!ok) {
+                        std::cerr << "bench: " << offsetKernelName(kernel) << " kernel differs from the per-character "
+                            "code on " << len << " bytes from byte " << first << " at offset " << start << std::endl;
+                        return 1;
+                    }
+                    checked++;
+                }
+            }
+        }
+    }
+    int oldDecryptWrong = 0;
+    for (int c = 0; c < 256; c++) {
+        std::string byte(1, (char)c);
+        oldDecryptWrong += scalarDecryptOffset(byte, false) != decryptOffset(byte);
+    }
+
+    // encrypted member-file lines: "username, password"
+    std::mt19937 rng(23);
+    static const char printable[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&*+-.?@_";
+    std::string text;
+    text.reserve(megabytes << 20);
+    while (text.length() < (size_t)(megabytes << 20)) {
+        for (int i = 5 + rng() % 20; i > 0; i--) {
+            text += printable[rng() % 26];
+        }
+        text += ", ";
+        for (int i = 5 + rng() % 20; i > 0; i--) {
+            text += printable[rng() % (sizeof printable - 1)];
+        }
+        text += '\n';
+    }
+    text.resize(megabytes << 20);
+
+    std::cout << "kernel,mb_per_sec_encrypt,mb_per_sec_decrypt" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    std::string copy = scalarDecryptOffset(scalarEncryptOffset(text), true);
+    double perChar = secondsSince(start) / 2;
+    std::cout << "per_char_string," << megabytes / perChar << "," << megabytes / perChar << std::endl;
+    for (enum OffsetKernel kernel : kernels) {
+        double seconds[2] = {0, 0};
+        for (int round = 0; round < rounds; round++) {
+            for (int decrypt = 0; decrypt < 2; decrypt++) {
+                start = std::chrono::steady_clock::now();
+                applyOffsetCipherWith(kernel, copy.data(), copy.length(), decrypt);
+                seconds[decrypt] += secondsSince(start);
+            }
+        }
+        if (copy != text) {
+            std::cerr << "bench: " << offsetKernelName(kernel) << " kernel did not decrypt what it encrypted" << std::endl;
+            return 1;
+        }
+        std::cout << offsetKernelName(kernel) << "," << megabytes * rounds / seconds[0] << ","
+            << megabytes * rounds / seconds[1] << std::endl;
+    }
+    std::cout << "checked " << checked << " strings; picked kernel " << offsetKernelName(bestOffsetKernel())
+        << "; the old decrypt_offset was wrong on " << oldDecryptWrong << " of 256 byte values" << std::endl;
+    return 0;
+}
+
+
+/**
+ * recover: snapshot a generated room table, log random reservations to a write-ahead log in group commits,
+ * then time a restart (loading the snapshot and replaying the log) and check it against the live table.
+ * Options: -n number of room layouts, -r number of logged reservations, -g records per group commit,
+ * -F fsync interval in ms (0: fdatasync every group commit, -1: never), -f path prefix of the files
+ */
+static int benchRecover(int argc, char *argv[]) {
+    long numRooms = 2000000;
+    long numRecords = 200000;
+    long groupSize = 32;
+    long fsyncIntervalMs = 0;
+    std::string path = "/tmp/bench_rooms";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:g:F:f:")) != -1) {
+        if (opt == 'n') {
+            numRooms = std::max(1L, atol(optarg));
+        } else if (opt == 'r') {
+            numRecords = std::max(0L, atol(optarg));
+        } else if (opt == 'g') {
+            groupSize = std::max(1L, atol(optarg));
+        } else if (opt == 'F') {
+            fsyncIntervalMs = atol(optarg);
+        } else if (opt == 'f') {
+            path = optarg;
+        } else {
+            return 1;
+        }
+    }
+    unlink((path + ".wal").c_str());
+
+    RoomIndex live;
+    live.reserve(numRooms);
+    for (long i = 0; i < numRooms; i++) {
+        live.assign("S" + std::to_string(i), 1000);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!live.save(path + ".snap")) {
+        return 1;
+    }
+    double snapshotTime = secondsSince(start);
+
+    std::mt19937 rng(450);
+    {
+        WriteAheadLog wal;
+        RoomIndex empty;
+        if (wal.open(path + ".wal", fsyncIntervalMs, empty, 0) == -1) {
+            return 1;
+        }
+        start = std::chrono::steady_clock::now();
+        for (long i = 0; i < numRecords; i++) {
+            uint32_t id = rng() % numRooms;
+            live.count(id) -= 1;
+            wal.append(live.code(id), -1);
+            if ((i + 1) % groupSize == 0 && !wal.commit()) {
+                return 1;
+            }
+        }
+        if (!wal.commit() || !wal.sync()) {
+            return 1;
+        }
+    }
+    double logTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    RoomIndex restored;
+    uint64_t snapshotLsn;
+    WriteAheadLog wal;
+    if (!restored.map(path + ".snap", snapshotLsn)) {
+        return 1;
+    }
+    long numReplayed = wal.open(path + ".wal", -1, restored, snapshotLsn);
+    double recoverTime = secondsSince(start);
+    unlink((path + ".snap").c_str());
+    unlink((path + ".wal").c_str());
+
+    if (numReplayed != numRecords || restored.size() != live.size()) {
+        std::cerr << "bench: replayed " << numReplayed << " of " << numRecords << " records" << std::endl;
+        return 1;
+    }
+    for (uint32_t id = 0; id < live.size(); id++) {
+        if (restored.code(id) != live.code(id) || restored.count(id) != live.count(id)) {
+            std::cerr << "bench: restored room " << live.code(id) << " differs" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "phase,rooms,records,seconds" << std::endl;
+    std::cout << "snapshot," << numRooms << ",0," << snapshotTime << std::endl;
+    std::cout << "log_g" << groupSize << "," << numRooms << "," << numRecords << "," << logTime << std::endl;
+    std::cout << "recover," << numRooms << "," << numRecords << "," << recoverTime << std::endl;
+    return 0;
+}
+
+
+/**
+ * oversell: many threads reserve the same hot room at once, with the lock-free decrement-if-positive of RoomIndex
+ * and with a mutex around check-then-decrement. Every thread keeps trying (and gives back every fourth room it
+ * got) until the room is sold out; the final count and the number of rooms taken must match exactly.
+ * Options: -t threads, -n available rooms at the start
+ */
+static int benchOversell(int argc, char *argv[]) {
+    int numThreads = std::max(8u, std::thread::hardware_concurrency() * 2);
+    long numRooms = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        if (opt == 't') {
+            numThreads = std::max(1, atoi(optarg));
+        } else if (opt == 'n') {
+            numRooms = std::max(1L, std::min<long>(INT_MAX, atol(optarg)));
+        } else {
+            return 1;
+        }
+    }
+
+    std::cout << "method,threads,rooms,taken,returned,final_count,ns_per_attempt" << std::endl;
+    for (bool lockFree : {true, false}) {
+        RoomIndex rooms;
+        rooms.assign("S233", numRooms);
+        uint32_t id = rooms.find("S233");
+        std::mutex lock;
+        std::atomic<long> numTaken(0), numReturned(0), numAttempts(0), numNegative(0);
+
+        auto hammer = [&]() {
+            long taken = 0, returned = 0, attempts = 0;
+            while (true) {
+                int left;
+                attempts++;
+                if (lockFree) {
+                    left = rooms.takeOne(id);
+                } else {
+                    std::lock_guard<std::mutex> guard(lock);
+                    left = rooms.count(id) > 0 ? --rooms.count(id) : -1;
+                }
+                if (left < 0) {
+                    break; // sold out
+                }
+                if (++taken % 4 == 0) {
+                    if (lockFree) {
+                        rooms.giveOne(id);
+                    } else {
+                        std::lock_guard<std::mutex> guard(lock);
+                        rooms.count(id)++;
+                    }
+                    returned++;
+                }
+                numNegative += rooms.load(id) < 0;
+            }
+            numTaken += taken;
+            numReturned += returned;
+            numAttempts += attempts;
+        };
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < numThreads; i++) {
+            threads.emplace_back(hammer);
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+        double seconds = secondsSince(start);
+
+        int finalCount = rooms.load(id);
+        if (finalCount != 0 || numTaken - numReturned != numRooms || numNegative != 0) {
+            std::cerr << "bench: " << (lockFree ? "lock-free" : "mutex") << " reservations oversold or lost rooms: took "
+                << numTaken << ", returned " << numReturned << ", final count " << finalCount << std::endl;
+            return 1;
+        }
+        std::cout << (lockFree ? "cas" : "mutex") << "," << numThreads << "," << numRooms << "," << numTaken << ","
+            << numReturned << "," << finalCount << "," << seconds * 1e9 / numAttempts << std::endl;
+    }
+    return 0;
+}
+
+
+/**
+ * Shard map of one building type served by a number of shards S1, S2, ...
+ * @param numShards number of shards
+ * @return the shard map
+ */
+static ShardMap shardsOf(int numShards) {
+    std::string conf;
+    for (int i = 1; i <= numShards; i++) {
+        conf += "S" + std::to_string(i) + " S " LOCAL_HOST " " + std::to_string(41902 + 10 * i) + "\n";
+    }
+    std::istringstream in(conf);
+    ShardMap shards;
+    shards.parse(in, "bench");
+    return shards;
+}
+
+
+/**
+ * shard: spread room codes over 1 to -k shards of one building type by consistent hashing; reports each shard
+ * count's most and least loaded shard (relative to an even share), the share of room codes that move to another
+ * shard when one more shard is added (1/shards is the least possible) and the cost of routing a room code.
+ * Options: -n room codes, -k max number of shards
+ */
+static int benchShard(int argc, char *argv[]) {
+    long numRooms = 1000000;
+    int maxShards = 16;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:k:")) != -1) {
+        if (opt == 'n') {
+            numRooms = std::max(1L, atol(optarg));
+        } else if (opt == 'k') {
+            maxShards = std::max(1, atoi(optarg));
+        } else {
+            return 1;
+        }
+    }
+    std::vector<std::string> roomcodes(numRooms);
+    for (long i = 0; i < numRooms; i++) {
+        roomcodes[i] = "S" + std::to_string(100000 + i);
+    }
+
+    std::cout << "shards,max_load,min_load,moved_when_added,ideal_moved,route_ns" << std::endl;
+    std::vector<std::string> before;
+    for (int numShards = 1; numShards <= maxShards; numShards++) {
+        ShardMap shards = shardsOf(numShards);
+        std::map<std::string, long> loads;
+        std::vector<std::string> owners(numRooms);
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < numRooms; i++) {
+            owners[i] = shards.route(roomcodes[i]);
+        }
+        double seconds = secondsSince(start);
+
+        long numMoved = 0;
+        for (long i = 0; i < numRooms; i++) {
+            loads[owners[i]]++;
+            if (!before.empty() && owners[i] != before[i]) {
+                if (owners[i] != "S" + std::to_string(numShards)) { // moved between shards that were there before
+                    std::cerr << "bench: " << roomcodes[i] << " moved from " << before[i] << " to " << owners[i]
+                        << " when adding a shard" << std::endl;
+                    return 1;
+                }
+                numMoved++;
+            }
+        }
+        if ((int)loads.size() != std::min<long>(numShards, numRooms)) {
+            std::cerr << "bench: only " << loads.size() << " of " << numShards << " shards got room codes" << std::endl;
+            return 1;
+        }
+        long maxLoad = 0, minLoad = numRooms;
+        for (const auto& load : loads) {
+            maxLoad = std::max(maxLoad, load.second);
+            minLoad = std::min(minLoad, load.second);
+        }
+        double evenShare = (double)numRooms / numShards;
+        std::cout << numShards << "," << maxLoad / evenShare << "," << minLoad / evenShare << ","
+            << (before.empty() ? 0 : (double)numMoved / numRooms) << "," << (before.empty() ? 0 : 1.0 / numShards) << ","
+            << seconds * 1e9 / numRooms << std::endl;
+        before = std::move(owners);
+    }
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    std::map<std::string, std::pair<std::function<int(int, char **)>, std::string>> cases = {
+        {"accept", {benchAccept, "connections/sec of serverM per number of reactor threads"}},
+        {"wire", {benchWire, "encode/decode cost of the text and the binary client protocol"}},
+        {"parse", {benchParse, "line scanners checked against and timed against the regular expressions"}},
+        {"load", {benchLoad, "startup time of loading a generated multi-million-line room inventory"}},
+        {"lookup", {benchLookup, "room lookups in the flat room index against std::map over a million rooms"}},
+        {"login", {benchLogin, "member lookups of logins in the member index against std::map over a million members"}},
+        {"cipher", {benchCipher, "offset cipher kernels: exhaustive check against the per-character code, and MB/s"}},
+        {"oversell", {benchOversell, "many threads reserving one hot room: exact final count, lock-free against a mutex"}},
+        {"shard", {benchShard, "spread of room codes over consistent-hashing shards, and how many move when one is added"}},
+        {"recover", {benchRecover, "restart from a snapshot plus write-ahead log tail, and group-committed logging"}},
+    };
+
+    if (argc < 2 || cases.find(argv[1]) == cases.end()) {
+        std::cerr << "Usage: " << argv[0] << " <case> [options]" << std::endl;
+        for (const auto& pair : cases) {
+            std::cerr << "  " << pair.first << ": " << pair.second.second << std::endl;
+        }
+        return 1;
+    }
+    // let getopt() of the case start right after the case name
+    return cases[argv[1]].first(argc - 1, argv + 1);
+}
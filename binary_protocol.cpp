@@ -0,0 +1,117 @@
+#include "server_utils.h"
+#include <endian.h>
+
+
+// op code table; a binary opcode is the index of its text op code
+static const char *const OPCODES[] = {
+    MSG_LOGIN_REQUEST, MSG_LOGIN_FAIL, MSG_LOGIN_MEMBER, MSG_LOGIN_GUEST, MSG_LOGIN_NOTFOUND,
+    MSG_LOGIN_INVALID_USERNAME, MSG_LOGIN_INVALID_PASSWORD,
+    MSG_CHECK_REQUEST, MSG_CHECK_UNAVAILABLE, MSG_CHECK_AVAILABLE, MSG_CHECK_NOTFOUND,
+    MSG_RESERVE_REQUEST, MSG_RESERVE_FAIL, MSG_RESERVE_SUCCEED, MSG_RESERVE_NOTFOUND, MSG_RESERVE_DENIED,
+    MSG_REQUEST_TIMEOUT,
+    MSG_CHECK_BATCH, MSG_CHECK_BATCH_RESULT, MSG_RESERVE_BATCH, MSG_RESERVE_BATCH_RESULT,
+    MSG_RESERVE_ABORTED,
+    MSG_LOGIN_EXPIRED, MSG_SESSION_TOKEN, MSG_RESUME_REQUEST,
+    MSG_RESERVE_UNCOMMITTED,
+};
+static const int NUM_OPCODES = sizeof(OPCODES) / sizeof(OPCODES[0]);
+
+
+/**
+ * Get the binary opcode of a text op code
+ * @param op text op code, e.g. "CH"
+ * @return opcode, or BINARY_UNKNOWN_OP
+ */
+uint8_t binaryOpcodeOf(std::string_view op) {
+    for (int i = 0; i < NUM_OPCODES; i++) {
+        if (op == OPCODES[i]) {
+            return i;
+        }
+    }
+    return BINARY_UNKNOWN_OP;
+}
+
+
+/**
+ * Append one frame to an output buffer
+ * @param out output buffer
+ * @param op text op code
+ * @param requestId request ID / sequence number
+ * @param payload payload, at most BINARY_MAX_PAYLOAD bytes
+ * @return whether successful; false for unknown op codes and oversized payloads
+ */
+bool encodeFrame(std::string& out, std::string_view op, uint64_t requestId, std::string_view payload) {
+    uint8_t opcode = binaryOpcodeOf(op);
+    if (opcode == BINARY_UNKNOWN_OP || payload.length() > BINARY_MAX_PAYLOAD) {
+        return false;
+    }
+    char header[BINARY_HEADER_LEN];
+    uint16_t length = htons(payload.length());
+    uint64_t id = htobe64(requestId);
+    header[0] = (char)BINARY_MAGIC;
+    header[1] = (char)opcode;
+    memcpy(header + 2, &length, sizeof length);
+    memcpy(header + 4, &id, sizeof id);
+    out.append(header, BINARY_HEADER_LEN);
+    out.append(payload.data(), payload.length());
+    return true;
+}
+
+
+/**
+ * Append one CH/RE request frame carrying a fixed-width roomcode to an output buffer
+ * @param out output buffer
+ * @param op MSG_CHECK_REQUEST or MSG_RESERVE_REQUEST
+ * @param requestId sequence number of the request
+ * @param roomcode room layout code, at most ROOMCODE_WIDTH bytes
+ * @return whether successful; false if the roomcode does not fit
+ */
+bool encodeRoomRequest(std::string& out, std::string_view op, uint64_t requestId, std::string_view roomcode) {
+    if (roomcode.length() > ROOMCODE_WIDTH) {
+        return false;
+    }
+    char field[ROOMCODE_WIDTH] = {0};
+    memcpy(field, roomcode.data(), roomcode.length());
+    return encodeFrame(out, op, requestId, std::string_view(field, ROOMCODE_WIDTH));
+}
+
+
+/**
+ * Decode one frame at the start of a buffer, without copying or allocating
+ * @param data buffer
+ * @param len number of bytes in the buffer
+ * @param frame to store the decoded frame; its views point into data
+ * @return bytes taken by the frame, 0 if the frame is not complete yet, -1 if the bytes are not a valid frame
+ */
+long decodeFrame(const char *data, size_t len, BinaryFrame& frame) {
+    if (len < BINARY_HEADER_LEN) {
+        return 0;
+    }
+    uint8_t opcode = data[1];
+    uint16_t length;
+    uint64_t id;
+    memcpy(&length, data + 2, sizeof length);
+    memcpy(&id, data + 4, sizeof id);
+    length = ntohs(length);
+    if ((uint8_t)data[0] != BINARY_MAGIC || opcode >= NUM_OPCODES || length > BINARY_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (len < (size_t)BINARY_HEADER_LEN + length) {
+        return 0;
+    }
+    frame.op = OPCODES[opcode];
+    frame.requestId = be64toh(id);
+    frame.payload = std::string_view(data + BINARY_HEADER_LEN, length);
+    return BINARY_HEADER_LEN + length;
+}
+
+
+/**
+ * Get the roomcode out of a fixed-width roomcode field
+ * @param field ROOMCODE_WIDTH-byte field
+ * @return the roomcode without padding
+ */
+std::string_view roomcodeOf(std::string_view field) {
+    size_t end = field.find('\0');
+    return end == std::string_view::npos ? field : field.substr(0, end);
+}
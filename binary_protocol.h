@@ -0,0 +1,89 @@
+#ifndef BINARYPROTOCOL_H
+#define BINARYPROTOCOL_H
+
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+
+// Length-prefixed binary framing between clients and the main server, used instead of the newline text
+// protocol when the first byte a client sends is BINARY_MAGIC (text messages always start with a letter).
+//
+// Frame: a fixed BINARY_HEADER_LEN-byte header followed by the payload, all integers in network byte order
+//   uint8  magic       BINARY_MAGIC
+//   uint8  opcode      index of the text op code in the op code table (see binaryOpcodeOf)
+//   uint16 length      payload length in bytes
+//   uint64 requestId   the request's sequence number, echoed in its reply; 0 for login messages
+// Payload:
+//   LI      "(encrypted_username),(encrypted_password)"
+//   LT/LR   session token
+//   CH/RE   roomcode as a fixed-width ROOMCODE_WIDTH-byte field, padded with '\0'
+//   CHB/REB comma-separated roomcodes
+//   CHB_R/REB_R comma-separated result op codes, one per roomcode of the request
+//   other replies empty
+#define BINARY_MAGIC 0xEE
+#define BINARY_HEADER_LEN 12
+#define BINARY_MAX_PAYLOAD 1024
+#define BINARY_UNKNOWN_OP 0xFF
+#define ROOMCODE_WIDTH 16
+
+
+// A decoded frame. op and payload point into the decoded buffer (or the op code table); nothing is copied.
+struct BinaryFrame {
+    std::string_view op;
+    uint64_t requestId;
+    std::string_view payload;
+};
+
+
+/**
+ * Get the binary opcode of a text op code
+ * @param op text op code, e.g. "CH"
+ * @return opcode, or BINARY_UNKNOWN_OP
+ */
+uint8_t binaryOpcodeOf(std::string_view op);
+
+
+/**
+ * Append one frame to an output buffer
+ * @param out output buffer
+ * @param op text op code
+ * @param requestId request ID / sequence number
+ * @param payload payload, at most BINARY_MAX_PAYLOAD bytes
+ * @return whether successful; false for unknown op codes and oversized payloads
+ */
+bool encodeFrame(std::string& out, std::string_view op, uint64_t requestId, std::string_view payload);
+
+
+/**
+ * Append one CH/RE request frame carrying a fixed-width roomcode to an output buffer
+ * @param out output buffer
+ * @param op MSG_CHECK_REQUEST or MSG_RESERVE_REQUEST
+ * @param requestId sequence number of the request
+ * @param roomcode room layout code, at most ROOMCODE_WIDTH bytes
+ * @return whether successful; false if the roomcode does not fit
+ */
+bool encodeRoomRequest(std::string& out, std::string_view op, uint64_t requestId, std::string_view roomcode);
+
+
+/**
+ * Decode one frame at the start of a buffer, without copying or allocating
+ * @param data buffer
+ * @param len number of bytes in the buffer
+ * @param frame to store the decoded frame; its views point into data
+ * @return bytes taken by the frame, 0 if the frame is not complete yet, -1 if the bytes are not a valid frame
+ */
+long decodeFrame(const char *data, size_t len, BinaryFrame& frame);
+
+
+/**
+ * Get the roomcode out of a fixed-width roomcode field
+ * @param field ROOMCODE_WIDTH-byte field
+ * @return the roomcode without padding
+ */
+std::string_view roomcodeOf(std::string_view field);
+
+
+#endif //BINARYPROTOCOL_H
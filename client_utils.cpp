@@ -0,0 +1,557 @@
+#include "client_utils.h"
+
+// #define DEBUG
+
+
+bool Client::tryRecvTCP(std::vector<std::string>& fields) {
+    int numbytes; // number of bytes received
+    char buf[MAXBUFLEN];
+    size_t pos = 0;
+    struct BinaryFrame frame;
+    long taken = 0;
+
+    fields.clear();
+    while (connected &&
+           (binary ? (taken = decodeFrame(inBuf.data(), inBuf.length(), frame)) == 0 : !takeMessage(inBuf, pos, fields))) {
+        numbytes = recv(sockfd, buf, MAXBUFLEN, 0);
+        if (numbytes == -1) {
+            if (!quiet) {
+                perror("recv");
+            }
+            connected = false;
+        }
+        else if (numbytes == 0) {
+            if (!quiet) {
+                std::cout << "The main server closed the connection." << std::endl;
+            }
+            connected = false;
+        }
+        else {
+            inBuf.append(buf, numbytes);
+        }
+    }
+    if (connected && taken == -1) {
+        if (!quiet) {
+            std::cout << "Received an invalid message from the main server." << std::endl;
+        }
+        connected = false; // the rest of the stream cannot be framed
+    }
+    if (!connected) {
+        fields.clear();
+        return false;
+    }
+    if (binary) {
+        fields = {std::string(frame.op), std::to_string(frame.requestId), std::string(frame.payload)};
+        pos = taken;
+    }
+    inBuf.erase(0, pos);
+#ifdef DEBUG
+    std::cout << "Received message over TCP socket: " << fields[0] << std::endl;
+#endif
+    return true;
+}
+
+
+std::vector<std::string> Client::recvTCP() {
+    std::vector<std::string> fields;
+    if (!tryRecvTCP(fields)) {
+        exit(1);
+    }
+    return fields;
+}
+
+
+bool Client::isConnected() const {
+    return connected;
+}
+
+
+/**
+ * Receive the session token the main server sends after a successful login, and keep it in the session file
+ * together with the username
+ */
+void Client::saveSession() {
+    std::vector<std::string> fields;
+    if (!tryRecvTCP(fields) || fields[0] != MSG_SESSION_TOKEN || sessionFile.empty()) {
+        return;
+    }
+    std::string contents = username + "\n" + (binary ? fields[2] : fields[1]) + "\n";
+    int fd = open(sessionFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600); // the token logs in without a password
+    if (fd == -1) {
+        perror(("open " + sessionFile).c_str());
+        return;
+    }
+    if (write(fd, contents.data(), contents.length()) != (ssize_t)contents.length()) {
+        perror(("write " + sessionFile).c_str());
+    }
+    close(fd);
+}
+
+
+/**
+ * send message over a TCP socket to the server
+ */
+void Client::sendTCP(const std::string& msg) const {
+    // no SIGPIPE if the main server has closed the connection: the next receive tells
+    if (send(sockfd, msg.c_str(), msg.length(), MSG_NOSIGNAL) == -1) {
+        perror(("Send to server: " + msg).c_str());
+    }
+#ifdef DEBUG
+    std::cout << "Send message over TCP socket: " << msg << std::endl;
+#endif
+}
+
+
+Client::Client(const std::string& serverAddress, const std::string& serverPort, bool binary, bool group,
+               const std::string& sessionFile, bool quiet) {
+    sockfd = -1;
+    nextSeq = 0;
+    this->binary = binary;
+    this->group = group;
+    this->quiet = quiet;
+    this->sessionFile = sessionFile;
+    // loginStatus = false;
+    username = "";
+    this->serverAddress = serverAddress;
+    this->serverPort = serverPort;
+}
+
+
+Client::~Client() {
+    if (sockfd != -1) {
+        close(sockfd);
+    }
+}
+
+
+bool Client::bootup() {
+    struct addrinfo hints_TCP;
+    memset(&hints_TCP, 0, sizeof hints_TCP);
+    hints_TCP.ai_family = AF_INET; // use IPv4
+    hints_TCP.ai_socktype = SOCK_STREAM; // use TCP
+
+    struct addrinfo *serverInfo, *clientInfo;
+    struct sockaddr_in clientAddr;
+    socklen_t addrLen = sizeof(clientAddr);
+
+    // get serverInfo
+    if (getaddrinfo(serverAddress.c_str(), serverPort.c_str(), &hints_TCP, &serverInfo) != 0) {
+        perror("server: getaddrinfo");
+        return false;
+    }
+
+    // Create a TCP socket
+    if (getaddrinfo(LOCAL_HOST, nullptr, &hints_TCP, &clientInfo) != 0) {
+        perror("Client: getaddrinfo");
+        return false;
+    }
+    sockfd = socket(clientInfo->ai_family, clientInfo->ai_socktype, clientInfo->ai_protocol);
+    if (sockfd == -1) {
+        perror("Client: socket");
+        return false;
+    }
+    if (bind(sockfd, clientInfo->ai_addr, clientInfo->ai_addrlen) == -1) {
+        close(sockfd);
+        sockfd = -1;
+        perror("Client: bind");
+        return false;
+    }
+    // Get the dynamically assigned port
+    if (getsockname(sockfd, (struct sockaddr *)&clientAddr, &addrLen) == -1) {
+        perror("Client: getsockname");
+        return false;
+    }
+    clientPort = std::to_string(ntohs(clientAddr.sin_port));
+#ifdef DEBUG
+    std::cout << "Client's port: " << clientPort << std::endl;
+#endif
+    freeaddrinfo(clientInfo);
+
+    if (connect(sockfd, serverInfo->ai_addr, serverInfo->ai_addrlen) == -1) {
+        close(sockfd);
+        sockfd = -1;
+        perror("client: connect");
+        return false;
+    }
+    if (!quiet) {
+        std::cout << "Client is up and running." << std::endl;
+    }
+    return true;
+}
+
+
+bool Client::resume() {
+    std::ifstream inFile(sessionFile);
+    std::string saved_username, token;
+    if (!getline(inFile, saved_username) || !getline(inFile, token) || token.empty()) {
+        return false;
+    }
+    std::string msg;
+    if (binary) {
+        if (!encodeFrame(msg, MSG_RESUME_REQUEST, 0, token)) {
+            return false;
+        }
+    } else {
+        msg = MSG_RESUME_REQUEST "\n" + token + "\n";
+    }
+    sendTCP(msg);
+    std::cout << saved_username << " sent a session resume request to the main server." << std::endl;
+
+    std::string op = recvTCP()[0];
+    if (op != MSG_LOGIN_GUEST && op != MSG_LOGIN_MEMBER) {
+        std::cout << "The session of " << saved_username << " has expired. Please log in again." << std::endl;
+        return false;
+    }
+    username = saved_username;
+    std::cout << "Welcome back " << (op == MSG_LOGIN_MEMBER ? "member " : "guest ") << username << "!" << std::endl;
+    saveSession();
+    return true;
+}
+
+
+std::string Client::tryLogin(const std::string& input_username, const std::string& input_password) {
+    // send login request to server M
+    std::string msg, loginInfo = encryptOffset(input_username) + "," + encryptOffset(input_password);
+    if (binary) {
+        if (!encodeFrame(msg, MSG_LOGIN_REQUEST, 0, loginInfo)) {
+            return "";
+        }
+    } else {
+        msg = MSG_LOGIN_REQUEST;
+        msg += "\n" + loginInfo + "\n";
+    }
+    sendTCP(msg);
+    if (!quiet) { // before waiting for the result
+        if (input_password.empty()) {
+            std::cout << input_username << " sent a guest request to the main server using TCP over port "
+            << clientPort << "." << std::endl;
+        }
+        else {
+            std::cout << input_username << " sent an authentication request to the main server." << std::endl;
+        }
+    }
+
+    // get login result from server M
+    std::vector<std::string> fields;
+    if (!tryRecvTCP(fields)) {
+        return "";
+    }
+    std::string op = fields[0]; // the operation code
+    if (op == MSG_LOGIN_GUEST || op == MSG_LOGIN_MEMBER) {
+        username = input_username;
+        saveSession();
+    } else { // the main server has ended an earlier login of the connection too
+        username.clear();
+    }
+    return op;
+}
+
+
+void Client::login() {
+    std::string input_username, input_password;
+    bool loginStatus = false;
+    while (!loginStatus) {
+        input_username = "";
+        input_password = "";
+        std::cout << "Please enter the username: ";
+        std::getline(std::cin, input_username);
+        std::cout << "Please enter the password (Press “Enter” to skip for guest): ";
+        std::getline(std::cin, input_password);
+
+        std::string op = tryLogin(input_username, input_password);
+        if (!connected) {
+            exit(1);
+        }
+        if (op.empty()) { // nothing was sent
+            std::cout << "Failed login. The username and password are too long to send." << std::endl;
+            continue;
+        }
+
+        if (op == MSG_LOGIN_GUEST) {
+            loginStatus = true;
+            std::cout << "Welcome guest " << username << "!" << std::endl;
+        } else if (op == MSG_LOGIN_MEMBER) {
+            loginStatus = true;
+            std::cout << "Welcome member " << username << "!" << std::endl;
+        } else if (op == MSG_LOGIN_FAIL) {
+            std::cout << "Failed login. Password does not match." << std::endl;
+        } else if (op == MSG_LOGIN_NOTFOUND) {
+            std::cout << "Failed login. Username does not exist." << std::endl;
+        } else if (op == MSG_LOGIN_INVALID_USERNAME) {
+            std::cout << "Failed login. Invalid username" << std::endl;
+        } else if (op == MSG_LOGIN_INVALID_PASSWORD) {
+            std::cout << "Failed login. Invalid password" << std::endl;
+        }
+    }
+}
+
+
+std::string Client::sendRequest(const std::string& op, const std::string& roomcode) {
+    std::string seq = std::to_string(nextSeq++);
+    if (binary) {
+        std::string frame;
+        if (!encodeRoomRequest(frame, op, std::stoull(seq), roomcode)) {
+            return "";
+        }
+        sendTCP(frame);
+    } else {
+        sendTCP(op + "\n" + seq + "\n" + roomcode + "\n");
+    }
+    return seq;
+}
+
+
+std::string Client::sendBatchRequest(const std::string& op, const std::vector<std::string>& roomcodes) {
+    std::string seq = std::to_string(nextSeq++);
+    std::string list;
+    for (const std::string& roomcode : roomcodes) {
+        list += (list.empty() ? "" : ",") + roomcode;
+    }
+    if (binary) {
+        std::string frame;
+        if (!encodeFrame(frame, op, std::stoull(seq), list)) {
+            return "";
+        }
+        sendTCP(frame);
+    } else {
+        sendTCP(op + "\n" + seq + "\n" + list + "\n");
+    }
+    return seq;
+}
+
+
+/**
+ * Send the room layout codes of one input line as one batch request, and print the result of each
+ * @param op MSG_CHECK_BATCH or MSG_RESERVE_BATCH
+ * @param roomcodes room layout codes
+ */
+void Client::handleBatch(const std::string& op, const std::vector<std::string>& roomcodes) {
+    if (roomcodes.size() > MAX_BATCH_ROOMS) {
+        std::cout << "At most " << MAX_BATCH_ROOMS << " room layout codes fit in one request." << std::endl;
+        return;
+    }
+    std::string seq = sendBatchRequest(op, roomcodes);
+    if (seq.empty()) {
+        std::cout << "The room layout codes are too long." << std::endl;
+        return;
+    }
+    if (op == MSG_CHECK_BATCH) {
+        std::cout << username << " sent an availability request on " << roomcodes.size() << " rooms to the main server." << std::endl;
+    } else {
+        std::cout << username << " sent a reservation request on " << roomcodes.size() << " rooms to the main server." << std::endl;
+    }
+
+    std::vector<std::string> fields;
+    do {
+        fields = recvTCP();
+    } while (fields.size() < 3 || fields[1] != seq);
+    std::cout << "The client received the response from the main server using TCP over port " << clientPort << "." << std::endl;
+    std::istringstream results(fields[2]);
+    std::string result, uncommitted;
+    for (const std::string& roomcode : roomcodes) {
+        if (!getline(results, result, ',')) {
+            result = MSG_REQUEST_TIMEOUT;
+        }
+        std::cout << "Room " << roomcode << ": ";
+        printResponse(result, roomcode);
+        if (result == MSG_RESERVE_UNCOMMITTED) {
+            uncommitted += " " + roomcode;
+        }
+    }
+    if (!uncommitted.empty()) {
+        std::cout << "The group reservation was only partly made. Not reserved:" << uncommitted << std::endl;
+    }
+}
+
+
+/**
+ * Print the on-screen message of a response
+ * @param op response op code
+ * @param roomcode room layout code of the request
+ */
+void Client::printResponse(const std::string& op, const std::string& roomcode) {
+    if (op == MSG_CHECK_AVAILABLE) {
+        std::cout << "The requested room is available." << std::endl;
+    } else if (op == MSG_CHECK_UNAVAILABLE) {
+        std::cout << "The requested room is not available." << std::endl;
+    } else if (op == MSG_CHECK_NOTFOUND) {
+        std::cout << "Not able to find the room layout." << std::endl;
+    } else if (op == MSG_RESERVE_SUCCEED) {
+        std::cout << "Congratulation! The reservation for Room " << roomcode << " has been made." << std::endl;
+    } else if (op == MSG_RESERVE_FAIL) {
+        std::cout << "Sorry! The requested room is not available." << std::endl;
+    } else if (op == MSG_RESERVE_NOTFOUND) {
+        std::cout << "Oops! Not able to find the room." << std::endl;
+    } else if (op == MSG_RESERVE_ABORTED) {
+        std::cout << "Not reserved: another room of the group is not available." << std::endl;
+    } else if (op == MSG_RESERVE_UNCOMMITTED) {
+        std::cout << "Not reserved: the reservation of this room could not be completed, unlike other rooms of the group." << std::endl;
+    } else if (op == MSG_RESERVE_DENIED) {
+        std::cout << "Permission denied: Guest cannot make a reservation." << std::endl;
+    } else if (op == MSG_REQUEST_TIMEOUT) {
+        std::cout << "The main server did not get a response in time. Please try again." << std::endl;
+    }
+}
+
+
+void Client::handleRequests() {
+    while (true) {
+        std::string roomcodes, input_op, msg, roomcode;
+        std::cout << "Please enter the room layout code: ";
+        std::getline(std::cin, roomcodes);
+        std::cout << "Would you like to search for the availability or make a reservation? "
+        << "(Enter “Availability” to search for the availability or Enter “Reservation” to make a reservation ): ";
+        std::getline(std::cin, input_op);
+        if (!std::cin) {
+            return;
+        }
+#ifdef DEBUG
+        std::cout << "input_op: " << input_op << std::endl;
+#endif
+
+        std::map<std::string, std::string> pending; // sequence number: roomcode
+        std::istringstream iss(roomcodes);
+        std::string op = input_op == "Availability" ? MSG_CHECK_REQUEST :
+                         input_op == "Reservation" ? MSG_RESERVE_REQUEST : "";
+        if (group && !op.empty()) {
+            std::vector<std::string> batch;
+            while (iss >> roomcode) {
+                batch.push_back(roomcode);
+            }
+            if (!batch.empty()) {
+                handleBatch(op == MSG_CHECK_REQUEST ? MSG_CHECK_BATCH : MSG_RESERVE_BATCH, batch);
+                std::cout << std::endl << "-----Start a new request-----" << std::endl;
+            }
+            continue;
+        }
+        while (!op.empty() && iss >> roomcode) {
+            std::string seq = sendRequest(op, roomcode);
+            if (seq.empty()) {
+                std::cout << "Room layout code " << roomcode << " is too long." << std::endl;
+                continue;
+            }
+            pending[seq] = roomcode;
+            if (op == MSG_CHECK_REQUEST) {
+                std::cout << username << " sent an availability request to the main server." << std::endl;
+            } else {
+                std::cout << username << " sent a reservation request to the main server." << std::endl;
+            }
+        }
+        if (pending.empty()) {
+            continue;
+        }
+
+        // get responses
+        while (!pending.empty()) {
+            std::vector<std::string> fields = recvTCP();
+            auto request = pending.find(fields.size() > 1 ? fields[1] : "");
+            if (request == pending.end()) {
+                continue;
+            }
+            std::cout << "The client received the response from the main server using TCP over port " << clientPort << "." << std::endl;
+            printResponse(fields[0], request->second);
+            pending.erase(request);
+        }
+
+        std::cout << std::endl << "-----Start a new request-----" << std::endl;
+    }
+}
+
+
+bool Client::runScript(std::istream& script, std::ostream& results) {
+    results << "line,request,username,roomcode,result,latency_us\n";
+    std::string line, request;
+    int lineNumber = 0;
+    bool valid = true;
+    auto microsSince = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    };
+    while (getline(script, line)) {
+        lineNumber++;
+        std::istringstream iss(line);
+        if (!(iss >> request) || request[0] == '#') { // blank line or comment
+            continue;
+        }
+
+        if (request == "login") {
+            std::string input_username, input_password;
+            iss >> input_username;
+            getline(iss, input_password);
+            if (!input_password.empty()) {
+                input_password.erase(0, 1); // the space after the username
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::string op = input_username.empty() ? "" : tryLogin(input_username, input_password);
+            if (!connected) {
+                std::cerr << "client: script line " << lineNumber << ": the main server closed the connection" << std::endl;
+                exit(1);
+            }
+            if (op.empty()) { // nothing was sent: the earlier login is not used for the requests after this line
+                std::cerr << "client: script line " << lineNumber << ": invalid login" << std::endl;
+                username.clear();
+                valid = false;
+                continue;
+            }
+            results << lineNumber << ",login," << input_username << ",," << op << "," << microsSince(start) << "\n";
+            continue;
+        }
+
+        std::string op = request == "Availability" ? MSG_CHECK_REQUEST :
+                         request == "Reservation" ? MSG_RESERVE_REQUEST : "";
+        std::vector<std::string> roomcodes;
+        std::string roomcode;
+        while (iss >> roomcode) {
+            roomcodes.push_back(roomcode);
+        }
+        if (op.empty() || roomcodes.empty() || username.empty() || (group && roomcodes.size() > MAX_BATCH_ROOMS)) {
+            std::cerr << "client: script line " << lineNumber << ": " << (username.empty() && !op.empty() ?
+                "not logged in" : "expected \"Availability|Reservation <roomcode> ...\"") << std::endl;
+            valid = false;
+            continue;
+        }
+
+        if (group) {
+            auto start = std::chrono::steady_clock::now();
+            std::string seq = sendBatchRequest(op == MSG_CHECK_REQUEST ? MSG_CHECK_BATCH : MSG_RESERVE_BATCH, roomcodes);
+            std::vector<std::string> fields;
+            while (!seq.empty() && (fields.size() < 3 || fields[1] != seq)) {
+                fields = recvTCP();
+            }
+            double latency = microsSince(start);
+            std::istringstream batchResults(seq.empty() ? "" : fields[2]);
+            std::string result;
+            for (const std::string& code : roomcodes) {
+                if (!getline(batchResults, result, ',')) {
+                    result = seq.empty() ? "" : MSG_REQUEST_TIMEOUT; // empty: the request could not be encoded
+                }
+                results << lineNumber << "," << request << "," << username << "," << code << "," << result << ","
+                    << latency << "\n";
+            }
+            continue;
+        }
+
+        // sequence number: (roomcode, send time)
+        std::map<std::string, std::pair<std::string, std::chrono::steady_clock::time_point>> pending;
+        for (const std::string& code : roomcodes) {
+            auto start = std::chrono::steady_clock::now();
+            std::string seq = sendRequest(op, code);
+            if (seq.empty()) {
+                results << lineNumber << "," << request << "," << username << "," << code << ",,0\n";
+                continue;
+            }
+            pending[seq] = {code, start};
+        }
+        while (!pending.empty()) {
+            std::vector<std::string> fields = recvTCP();
+            auto sent = pending.find(fields.size() > 1 ? fields[1] : "");
+            if (sent == pending.end()) {
+                continue;
+            }
+            results << lineNumber << "," << request << "," << username << "," << sent->second.first << ","
+                << fields[0] << "," << microsSince(sent->second.second) << "\n";
+            pending.erase(sent);
+        }
+    }
+    results.flush();
+    return valid;
+}
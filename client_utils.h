@@ -0,0 +1,135 @@
+#ifndef CLIENTUTILS_H
+#define CLIENTUTILS_H
+
+
+#include "server_utils.h"
+
+
+
+class Client {
+private:
+    // bool loginStatus;
+    std::string username;
+
+    int sockfd;
+    std::string serverAddress;
+    std::string serverPort;
+    std::string clientPort;
+
+    bool binary; // speak the length-prefixed binary protocol instead of the text one
+    bool group; // send the room layout codes of one input line as one batch request
+    bool quiet; // print no on-screen messages, e.g. for load generation
+    std::string inBuf; // received bytes not yet forming a complete message
+    bool connected = true; // false once receiving failed: the connection was closed or lost, or its stream is invalid
+    long nextSeq; // sequence number of the next request
+    std::string sessionFile; // where the session token is kept between runs, empty if sessions are not kept
+
+    void saveSession();
+    void sendTCP(const std::string& msg) const;
+    void handleBatch(const std::string& op, const std::vector<std::string>& roomcodes);
+    static void printResponse(const std::string& op, const std::string& roomcode);
+
+public:
+    Client(const std::string& serverAddress, const std::string& serverPort, bool binary, bool group,
+           const std::string& sessionFile, bool quiet = false);
+
+    ~Client();
+
+
+    /**
+     * Creat & bind a TCP socket, connect to server M.
+     * @return whether successful or not
+     */
+    bool bootup();
+
+
+    /**
+     * Resume the session kept in the session file, if any, instead of logging in again
+     * @return whether a session was resumed
+     */
+    bool resume();
+
+
+    /**
+     * Send one login request with the given username & password (saying so on screen unless quiet) and wait for
+     * the result; on success the client is logged in as that user (and the session is kept if there is a session
+     * file)
+     * @param input_username username, not encrypted
+     * @param input_password password, not encrypted; empty to log in as a guest
+     * @return result op code: MSG_LOGIN_MEMBER, MSG_LOGIN_GUEST or a failure (MSG_LOGIN_FAIL, ...);
+     *         empty if the request cannot be encoded or the connection fails (see isConnected())
+     */
+    std::string tryLogin(const std::string& input_username, const std::string& input_password);
+
+
+    /**
+     * Keep prompting for username & password input and send request to server
+     * until successfully logged in as a member/guest.
+     */
+    void login();
+
+
+    /**
+     * Send one availability/reservation request to the main server without waiting for the response
+     * @param op MSG_CHECK_REQUEST or MSG_RESERVE_REQUEST
+     * @param roomcode room layout code
+     * @return the request's sequence number, echoed in its response; empty if the request cannot be encoded
+     */
+    std::string sendRequest(const std::string& op, const std::string& roomcode);
+
+
+    /**
+     * Send one batch availability/reservation request for several room layouts without waiting for the response
+     * @param op MSG_CHECK_BATCH or MSG_RESERVE_BATCH
+     * @param roomcodes room layout codes
+     * @return the request's sequence number, echoed in its response; empty if the request cannot be encoded
+     */
+    std::string sendBatchRequest(const std::string& op, const std::vector<std::string>& roomcodes);
+
+
+    /**
+     * recv() until one complete message is buffered, and take it out of the buffer; exit if the connection fails
+     * @return the op code followed by the message's lines
+     */
+    std::vector<std::string> recvTCP();
+
+
+    /**
+     * recv() until one complete message is buffered, and take it out of the buffer, without exiting if the
+     * connection fails (closed or lost, or an invalid message): the client is then no longer connected
+     * @param fields to store the op code followed by the message's lines
+     * @return whether a message was received
+     */
+    bool tryRecvTCP(std::vector<std::string>& fields);
+
+
+    /**
+     * @return whether the connection to the main server is still usable, i.e. no receive has failed
+     */
+    bool isConnected() const;
+
+
+    /**
+     * Keep prompting for room layout codes and the request type. Several room layout codes separated by spaces
+     * are sent back-to-back (pipelined) without waiting for each response; responses may arrive in any order
+     * and are matched to their request by sequence number; in group mode they are sent as one batch request.
+     */
+    void handleRequests();
+
+
+    /**
+     * Run the requests of a script without prompts or on-screen messages, as fast as the main server answers:
+     * "login <username> [<password>]" (no password: as a guest), "Availability <roomcode> ..." and
+     * "Reservation <roomcode> ..." lines; blank lines and lines starting with '#' are skipped. The room layout
+     * codes of one line are pipelined (or sent as one batch request in group mode), as when entered on one line.
+     * @param script the script
+     * @param results to write one CSV line per login and per room: script line number, request, username,
+     *        roomcode, result op code and latency in microseconds from sending the request to receiving its result
+     * @return whether every line was valid; invalid lines (and requests while not logged in, e.g. after a failed
+     *         login) are reported on stderr and skipped
+     */
+    bool runScript(std::istream& script, std::ostream& results);
+};
+
+
+#endif //CLIENTUTILS_H
@@ -0,0 +1,358 @@
+#include "client_utils.h"
+#include <random>
+#include <cmath>
+
+// Load generator of the dormitory reservation system: many concurrent clients, one thread each, log in to the main
+// server as members or guests and keep sending Availability and Reservation requests over a uniform or Zipfian
+// distribution of room codes, then the throughput and latency percentiles are reported.
+// Usage: ./loadgen [options] with the main server and the backend servers running; see main for the options.
+
+
+/**
+ * Latencies in nanoseconds, counted in log-linear buckets: 16 buckets for each power of two, so a percentile is
+ * off by at most 1/16 of its value, and histograms of different threads merge by adding their counts
+ */
+class LatencyHistogram {
+private:
+    static const int SUB_BUCKETS = 16;
+    std::vector<long> counts = std::vector<long>(64 * SUB_BUCKETS, 0);
+    long total = 0;
+    long maxNs = 0;
+
+    static size_t bucketOf(long ns) {
+        if (ns < SUB_BUCKETS) {
+            return ns < 0 ? 0 : ns;
+        }
+        int msb = 63 - __builtin_clzl(ns);
+        return (msb - 3) * SUB_BUCKETS + ((ns >> (msb - 4)) & (SUB_BUCKETS - 1));
+    }
+
+    static long lowestOf(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        int msb = bucket / SUB_BUCKETS + 3;
+        return (long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (msb - 4);
+    }
+
+public:
+    void record(long ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+        maxNs = std::max(maxNs, ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        maxNs = std::max(maxNs, other.maxNs);
+    }
+
+    long count() const {
+        return total;
+    }
+
+    long max() const {
+        return maxNs;
+    }
+
+    /**
+     * @param fraction e.g. 0.99
+     * @return the upper end of the bucket holding that fraction of the latencies, in nanoseconds; 0 if empty
+     */
+    long percentile(double fraction) const {
+        long rank = (long)(fraction * total), seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                return std::min(maxNs, lowestOf(i + 1) - 1);
+            }
+        }
+        return maxNs;
+    }
+
+    /**
+     * Print the number of latencies below each power of two microseconds, from the first non-empty one
+     */
+    void print() const {
+        std::cout << "latency_us_below,requests" << std::endl;
+        long below = 0;
+        size_t i = 0;
+        for (long limit = 1; below < total; limit *= 2) {
+            long n = 0;
+            for (; i < counts.size() && lowestOf(i) < limit * 1000; i++) {
+                n += counts[i];
+            }
+            if (n > 0 || below > 0) {
+                std::cout << limit << "," << n << std::endl;
+            }
+            below += n;
+        }
+    }
+};
+
+
+// counted as the reply of each request outstanding when a client's connection fails; that client stops
+#define DISCONNECTED "disconnected"
+
+
+// what every client does
+struct Workload {
+    std::vector<std::string> roomcodes; // in order of popularity
+    std::vector<double> popularity; // cumulative weight of the room codes up to each one
+    std::vector<std::pair<std::string, std::string>> members; // usernames and passwords, not encrypted
+    int availabilityPercent;
+    int memberPercent;
+    int depth; // requests a client keeps outstanding
+    bool binary;
+};
+
+
+// what one client measured
+struct ClientStats {
+    LatencyHistogram login, check, reserve;
+    std::map<std::string, long> replies; // reply op code: count
+};
+
+
+/**
+ * Read the room codes of room inventories ("roomcode, available number" lines)
+ * @param files comma separated input files
+ * @param roomcodes to add the room codes to
+ */
+static void readRoomcodes(const std::string& files, std::vector<std::string>& roomcodes) {
+    std::istringstream list(files);
+    std::string file, line;
+    while (getline(list, file, ',')) {
+        std::ifstream inFile(file);
+        if (!inFile) {
+            perror(("loadgen: open " + file).c_str());
+        }
+        std::string_view roomcode;
+        int numAvailable;
+        while (getline(inFile, line)) {
+            if (scanRoomEntry(line, roomcode, numAvailable)) {
+                roomcodes.emplace_back(roomcode);
+            }
+        }
+    }
+}
+
+
+/**
+ * Read the members that can log in from a member file of encrypted "username, password" lines, and decrypt them
+ * @param file member file
+ * @param members to add the usernames and passwords to
+ */
+static void readMembers(const std::string& file, std::vector<std::pair<std::string, std::string>>& members) {
+    std::ifstream inFile(file);
+    if (!inFile) {
+        perror(("loadgen: open " + file).c_str());
+    }
+    std::string line;
+    std::string_view username, password;
+    while (getline(inFile, line)) {
+        if (scanMemberEntry(line, username, password) && isValidUsername(username) && isValidPassword(password)) {
+            members.emplace_back(decryptOffset(username), decryptOffset(password));
+        }
+    }
+}
+
+
+/**
+ * One client: log in, wait for the start, then keep the workload's number of requests outstanding until the
+ * deadline, and receive the responses still outstanding
+ * @param id client number
+ * @param workload what to send
+ * @param ready to count the clients logged in (or given up)
+ * @param deadline set by main once every client is ready, 0 until then; nanoseconds of the steady clock
+ * @param stats to store the measurements
+ */
+static void runClient(int id, const Workload& workload, std::atomic<int>& ready, const std::atomic<long>& deadline,
+                      ClientStats& stats) {
+    std::mt19937 rng(id);
+    Client client(LOCAL_HOST, PORT_SM_TCP, workload.binary, false, "", true);
+    bool member = !workload.members.empty() && (int)(rng() % 100) < workload.memberPercent;
+    std::string username, password;
+    if (member) {
+        std::tie(username, password) = workload.members[rng() % workload.members.size()];
+    } else { // guest usernames are letters only
+        username = "guest";
+        for (int n = id; n > 0 || username.length() < 6; n /= 26) {
+            username += (char)('a' + n % 26);
+        }
+    }
+
+    std::string op;
+    if (client.bootup()) {
+        auto start = std::chrono::steady_clock::now();
+        op = client.tryLogin(username, password);
+        stats.login.record((std::chrono::steady_clock::now() - start).count());
+        stats.replies[client.isConnected() ? op : DISCONNECTED]++;
+    }
+    ready++;
+    while (deadline == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (op != MSG_LOGIN_MEMBER && op != MSG_LOGIN_GUEST) {
+        return;
+    }
+
+    // sequence number: (op code, send time)
+    std::map<std::string, std::pair<std::string, std::chrono::steady_clock::time_point>> pending;
+    std::uniform_real_distribution<double> pick(0, workload.popularity.back());
+    while (true) {
+        bool sending = std::chrono::steady_clock::now().time_since_epoch().count() < deadline;
+        while (sending && (int)pending.size() < workload.depth) {
+            size_t rank = std::upper_bound(workload.popularity.begin(), workload.popularity.end(), pick(rng)) -
+                          workload.popularity.begin();
+            const std::string& roomcode = workload.roomcodes[std::min(rank, workload.roomcodes.size() - 1)];
+            std::string request = (int)(rng() % 100) < workload.availabilityPercent ? MSG_CHECK_REQUEST
+                                                                                     : MSG_RESERVE_REQUEST;
+            auto sent = std::chrono::steady_clock::now();
+            std::string seq = client.sendRequest(request, roomcode);
+            if (!seq.empty()) {
+                pending[seq] = {request, sent};
+            }
+        }
+        if (pending.empty()) {
+            return;
+        }
+        std::vector<std::string> fields;
+        if (!client.tryRecvTCP(fields)) { // every outstanding request of this client fails; the others go on
+            stats.replies[DISCONNECTED] += pending.size();
+            return;
+        }
+        auto request = pending.find(fields.size() > 1 ? fields[1] : "");
+        if (request == pending.end()) {
+            continue;
+        }
+        long latency = (std::chrono::steady_clock::now() - request->second.second).count();
+        (request->second.first == MSG_CHECK_REQUEST ? stats.check : stats.reserve).record(latency);
+        stats.replies[fields[0]]++;
+        pending.erase(request);
+    }
+}
+
+
+/**
+ * Print one line of latency percentiles
+ * @param name what was measured
+ * @param histogram the latencies
+ */
+static void printLatencies(const std::string& name, const LatencyHistogram& histogram) {
+    std::cout << name << "," << histogram.count() << "," << histogram.percentile(0.5) / 1e3 << ","
+        << histogram.percentile(0.99) / 1e3 << "," << histogram.percentile(0.999) / 1e3 << ","
+        << histogram.max() / 1e3 << std::endl;
+}
+
+
+int main(int argc, char *argv[]) {
+    // -c: number of concurrent clients (connections)
+    // -d: seconds to send requests for
+    // -a: percentage of Availability requests; the others are Reservation requests
+    // -m: percentage of clients logging in as members (from the member file); the others log in as guests
+    // -z: Zipf exponent of room code popularity; 0 picks room codes uniformly
+    // -p: requests each client keeps outstanding (pipelined)
+    // -b: use the binary protocol
+    // -r: comma separated room inventories to take the room codes from
+    // -f: member file to take the members from
+    int numClients = 64;
+    double duration = 10;
+    double zipf = 0;
+    std::string roomFiles = "single.txt,double.txt,suite.txt", memberFile = "member.txt";
+    Workload workload;
+    workload.availabilityPercent = 90;
+    workload.memberPercent = 50;
+    workload.depth = 1;
+    workload.binary = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:a:m:z:p:br:f:")) != -1) {
+        if (opt == 'c') {
+            numClients = std::max(1, atoi(optarg));
+        } else if (opt == 'd') {
+            duration = atof(optarg);
+        } else if (opt == 'a') {
+            workload.availabilityPercent = std::min(100, std::max(0, atoi(optarg)));
+        } else if (opt == 'm') {
+            workload.memberPercent = std::min(100, std::max(0, atoi(optarg)));
+        } else if (opt == 'z') {
+            zipf = std::max(0.0, atof(optarg));
+        } else if (opt == 'p') {
+            workload.depth = std::max(1, atoi(optarg));
+        } else if (opt == 'b') {
+            workload.binary = true;
+        } else if (opt == 'r') {
+            roomFiles = optarg;
+        } else if (opt == 'f') {
+            memberFile = optarg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-c clients] [-d seconds] [-a availability%] [-m member%]"
+                " [-z zipf_exponent] [-p depth] [-b] [-r room_files] [-f member_file]" << std::endl;
+            return 1;
+        }
+    }
+
+    readRoomcodes(roomFiles, workload.roomcodes);
+    readMembers(memberFile, workload.members);
+    if (workload.roomcodes.empty()) {
+        std::cerr << "loadgen: no room codes in " << roomFiles << std::endl;
+        return 1;
+    }
+    // popularity by rank, the ranks shuffled over the room codes so the hot ones are of every building type
+    std::shuffle(workload.roomcodes.begin(), workload.roomcodes.end(), std::mt19937(450));
+    double sum = 0;
+    for (size_t rank = 1; rank <= workload.roomcodes.size(); rank++) {
+        sum += 1 / std::pow((double)rank, zipf);
+        workload.popularity.push_back(sum);
+    }
+
+    std::atomic<int> ready(0);
+    std::atomic<long> deadline(0);
+    std::vector<ClientStats> stats(numClients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numClients; i++) {
+        threads.emplace_back(runClient, i, std::cref(workload), std::ref(ready), std::cref(deadline),
+                             std::ref(stats[i]));
+    }
+    while (ready < numClients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto start = std::chrono::steady_clock::now();
+    deadline = (start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(duration))).time_since_epoch().count();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ClientStats total;
+    LatencyHistogram all;
+    for (const ClientStats& s : stats) {
+        total.login.merge(s.login);
+        total.check.merge(s.check);
+        total.reserve.merge(s.reserve);
+        for (const auto& reply : s.replies) {
+            total.replies[reply.first] += reply.second;
+        }
+    }
+    all.merge(total.check);
+    all.merge(total.reserve);
+
+    std::cout << "clients,seconds,requests,requests_per_sec" << std::endl;
+    std::cout << numClients << "," << seconds << "," << all.count() << "," << all.count() / seconds << std::endl;
+    std::cout << "request,count,p50_us,p99_us,p999_us,max_us" << std::endl;
+    printLatencies("login", total.login);
+    printLatencies("availability", total.check);
+    printLatencies("reservation", total.reserve);
+    printLatencies("all", all);
+    all.print();
+    std::cout << "replies:";
+    for (const auto& reply : total.replies) {
+        std::cout << " " << (reply.first.empty() ? "(none)" : reply.first) << " " << reply.second;
+    }
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "member_index.h"
+#include <algorithm>
+
+
+/**
+ * FNV-1a hash of a username
+ * @param username encrypted username
+ * @return hash
+ */
+uint32_t MemberIndex::hashOf(std::string_view username) {
+    uint32_t hash = 2166136261u;
+    for (char c : username) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Compare a stored password with a given one without stopping at the first difference, so how long the
+ * comparison takes does not tell how much of the given password is right
+ * @param secret stored password
+ * @param given given password
+ * @return whether they are equal
+ */
+bool MemberIndex::equalsInConstantTime(std::string_view secret, std::string_view given) {
+    unsigned char diff = secret.length() != given.length();
+    for (size_t i = 0; i < secret.length(); i++) {
+        diff |= (unsigned char)secret[i] ^ (unsigned char)(i < given.length() ? given[i] : 0);
+    }
+    return diff == 0;
+}
+
+
+void MemberIndex::reserve(size_t numMembers, size_t numBytes) {
+    added.reserve(numMembers);
+    bytes.reserve(numBytes);
+}
+
+
+bool MemberIndex::add(std::string_view username, std::string_view password) {
+    if (username.length() > UINT16_MAX || password.length() > UINT16_MAX ||
+        bytes.size() + username.length() + password.length() >= UINT32_MAX) {
+        return false;
+    }
+    added.push_back(Slot{hashOf(username), (uint32_t)bytes.size(), (uint16_t)username.length(),
+                         (uint16_t)password.length()});
+    bytes.insert(bytes.end(), username.begin(), username.end());
+    bytes.insert(bytes.end(), password.begin(), password.end());
+    return true;
+}
+
+
+void MemberIndex::build() {
+    std::vector<Slot> entries;
+    for (const Slot& slot : slots) {
+        if (slot.offset != UINT32_MAX) {
+            entries.push_back(slot);
+        }
+    }
+    entries.insert(entries.end(), added.begin(), added.end());
+    added.clear();
+    added.shrink_to_fit();
+
+    size_t numSlots = 16;
+    while (numSlots / 2 < entries.size()) {
+        numSlots *= 2;
+    }
+    slots.assign(numSlots, Slot{0, UINT32_MAX, 0, 0});
+    size_t mask = numSlots - 1;
+    for (const Slot& entry : entries) {
+        size_t i = entry.hash & mask;
+        while (slots[i].offset != UINT32_MAX &&
+               (slots[i].hash != entry.hash || usernameOf(slots[i]) != usernameOf(entry))) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = entry; // a new slot, or the same username added again
+    }
+}
+
+
+enum MemberCheck MemberIndex::check(std::string_view username, std::string_view password) const {
+    if (slots.empty()) {
+        return MEMBER_NOT_FOUND;
+    }
+    uint32_t hash = hashOf(username);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i].offset != UINT32_MAX; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.hash == hash && usernameOf(slot) == username) {
+            std::string_view secret(bytes.data() + slot.offset + slot.usernameLen, slot.passwordLen);
+            return equalsInConstantTime(secret, password) ? MEMBER_MATCH : MEMBER_WRONG_PASSWORD;
+        }
+    }
+    return MEMBER_NOT_FOUND;
+}
+
+
+size_t MemberIndex::size() const {
+    return std::count_if(slots.begin(), slots.end(), [](const Slot& slot) { return slot.offset != UINT32_MAX; });
+}
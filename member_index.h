@@ -0,0 +1,85 @@
+#ifndef MEMBERINDEX_H
+#define MEMBERINDEX_H
+
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// result of looking up a member
+enum MemberCheck {
+    MEMBER_NOT_FOUND,
+    MEMBER_WRONG_PASSWORD,
+    MEMBER_MATCH,
+};
+
+
+// Member credentials (encrypted usernames and passwords), built once and then only read, so any number of
+// threads can look members up without a lock. Usernames and passwords are stored back to back in one byte array;
+// an open-addressing hash table with linear probing, at most half full, keeps in each slot the username's hash,
+// where its entry starts and the username and password lengths, so a lookup reads one slot (rarely a few
+// neighbours) and then the entry's bytes. Passwords are compared in constant time.
+class MemberIndex {
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t offset; // where the username starts in bytes, with the password right after; UINT32_MAX if empty
+        uint16_t usernameLen, passwordLen;
+    };
+
+    std::vector<Slot> slots; // the number of slots is a power of two
+    std::vector<Slot> added; // entries added but not built into slots yet, in order
+    std::vector<char> bytes; // usernames and passwords, back to back
+
+    static uint32_t hashOf(std::string_view username);
+    static bool equalsInConstantTime(std::string_view secret, std::string_view given);
+
+    std::string_view usernameOf(const Slot& slot) const {
+        return std::string_view(bytes.data() + slot.offset, slot.usernameLen);
+    }
+
+public:
+    /**
+     * Make room for a number of members, so adding them does not reallocate
+     * @param numMembers number of members
+     * @param numBytes total length of their usernames and passwords
+     */
+    void reserve(size_t numMembers, size_t numBytes);
+
+
+    /**
+     * Add a member before build(); a later entry of the same username replaces an earlier one
+     * @param username encrypted username
+     * @param password encrypted password
+     * @return whether added; false if the username or the password is longer than UINT16_MAX bytes, or the index
+     *         is full (4 GB of usernames and passwords)
+     */
+    bool add(std::string_view username, std::string_view password);
+
+
+    /**
+     * Build the hash table of all members added so far; after this the index is only read
+     */
+    void build();
+
+
+    /**
+     * Look up a member and compare the password; the comparison takes the same time wherever the passwords differ
+     * @param username encrypted username
+     * @param password encrypted password
+     * @return MEMBER_MATCH, MEMBER_WRONG_PASSWORD or MEMBER_NOT_FOUND
+     */
+    enum MemberCheck check(std::string_view username, std::string_view password) const;
+
+
+    /**
+     * @return number of members (built ones, each username counted once)
+     */
+    size_t size() const;
+};
+
+
+#endif //MEMBERINDEX_H
@@ -0,0 +1,180 @@
+#include "offset_cipher.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OFFSET_CIPHER_X86
+#endif
+
+
+/**
+ * Shift the bytes of one range: digits, lowercase or uppercase letters
+ * @param c byte
+ * @param first first byte of the range
+ * @param size number of bytes in the range
+ * @param shift OFFSET_CIPHER_SHIFT, or its negative to decrypt
+ * @return shifted byte, or c if it is not in the range
+ */
+static inline char shiftInRange(char c, char first, int size, int shift) {
+    if (c < first || c >= first + size) {
+        return c;
+    }
+    return first + (c - first + shift + size) % size;
+}
+
+
+/**
+ * The scalar kernel, which also takes the tail of the vector kernels
+ * @param data bytes, transformed in place
+ * @param len number of bytes
+ * @param decrypt shift back instead of forward
+ */
+static void shiftScalar(char *data, size_t len, bool decrypt) {
+    int shift = decrypt ? -OFFSET_CIPHER_SHIFT : OFFSET_CIPHER_SHIFT;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = shiftInRange(shiftInRange(shiftInRange(data[i], '0', 10, shift), 'a', 26, shift), 'A', 26, shift);
+    }
+}
+
+
+#ifdef OFFSET_CIPHER_X86
+// The vector kernels compare bytes as signed 8-bit integers: bytes from 0x80 up are negative, so they are in no
+// range. Within a range [first, last] of size n, encrypting adds SHIFT, or SHIFT - n to bytes past last - SHIFT;
+// decrypting adds -SHIFT, or n - SHIFT to bytes before first + SHIFT. No sum leaves the range, so none overflows.
+
+/**
+ * Per-byte amounts to add for one range, 0 for bytes outside it; 16 bytes at a time
+ * @param c bytes
+ * @param first first byte of the range
+ * @param last last byte of the range
+ * @param decrypt shift back instead of forward
+ * @return amounts to add
+ */
+__attribute__((target("sse2")))
+static inline __m128i rangeShift128(__m128i c, char first, char last, bool decrypt) {
+    char size = last - first + 1;
+    __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(first - 1)),
+                                    _mm_cmpgt_epi8(_mm_set1_epi8(last + 1), c));
+    __m128i wraps = decrypt ? _mm_cmpgt_epi8(_mm_set1_epi8(first + OFFSET_CIPHER_SHIFT), c)
+                            : _mm_cmpgt_epi8(c, _mm_set1_epi8(last - OFFSET_CIPHER_SHIFT));
+    __m128i shift = _mm_add_epi8(_mm_set1_epi8(decrypt ? -OFFSET_CIPHER_SHIFT : OFFSET_CIPHER_SHIFT),
+                                 _mm_and_si128(wraps, _mm_set1_epi8(decrypt ? size : -size)));
+    return _mm_and_si128(inRange, shift);
+}
+
+
+// the SSE2 kernel, 16 bytes per step
+__attribute__((target("sse2")))
+static void shiftSse2(char *data, size_t len, bool decrypt) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(data + i));
+        // the ranges do not overlap, so at most one amount is not 0
+        __m128i shift = _mm_or_si128(_mm_or_si128(rangeShift128(c, '0', '9', decrypt), rangeShift128(c, 'a', 'z', decrypt)),
+                                     rangeShift128(c, 'A', 'Z', decrypt));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_add_epi8(c, shift));
+    }
+    shiftScalar(data + i, len - i, decrypt);
+}
+
+
+/**
+ * Per-byte amounts to add for one range, 0 for bytes outside it; 32 bytes at a time
+ * @param c bytes
+ * @param first first byte of the range
+ * @param last last byte of the range
+ * @param decrypt shift back instead of forward
+ * @return amounts to add
+ */
+__attribute__((target("avx2")))
+static inline __m256i rangeShift256(__m256i c, char first, char last, bool decrypt) {
+    char size = last - first + 1;
+    __m256i inRange = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(first - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8(last + 1), c));
+    __m256i wraps = decrypt ? _mm256_cmpgt_epi8(_mm256_set1_epi8(first + OFFSET_CIPHER_SHIFT), c)
+                            : _mm256_cmpgt_epi8(c, _mm256_set1_epi8(last - OFFSET_CIPHER_SHIFT));
+    __m256i shift = _mm256_add_epi8(_mm256_set1_epi8(decrypt ? -OFFSET_CIPHER_SHIFT : OFFSET_CIPHER_SHIFT),
+                                    _mm256_and_si256(wraps, _mm256_set1_epi8(decrypt ? size : -size)));
+    return _mm256_and_si256(inRange, shift);
+}
+
+
+// the AVX2 kernel, 32 bytes per step; a tail of 16 or more bytes takes one SSE2 step
+__attribute__((target("avx2")))
+static void shiftAvx2(char *data, size_t len, bool decrypt) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i shift = _mm256_or_si256(_mm256_or_si256(rangeShift256(c, '0', '9', decrypt),
+                                                        rangeShift256(c, 'a', 'z', decrypt)),
+                                        rangeShift256(c, 'A', 'Z', decrypt));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_add_epi8(c, shift));
+    }
+    shiftSse2(data + i, len - i, decrypt);
+}
+#endif
+
+
+void applyOffsetCipherWith(enum OffsetKernel kernel, char *data, size_t len, bool decrypt) {
+#ifdef OFFSET_CIPHER_X86
+    if (kernel == OFFSET_KERNEL_AVX2) {
+        shiftAvx2(data, len, decrypt);
+        return;
+    }
+    if (kernel == OFFSET_KERNEL_SSE2) {
+        shiftSse2(data, len, decrypt);
+        return;
+    }
+#endif
+    shiftScalar(data, len, decrypt);
+}
+
+
+void applyOffsetCipher(char *data, size_t len, bool decrypt) {
+    applyOffsetCipherWith(bestOffsetKernel(), data, len, decrypt);
+}
+
+
+std::string encryptOffset(std::string_view input) {
+    std::string encrypted(input);
+    applyOffsetCipher(encrypted.data(), encrypted.length(), false);
+    return encrypted;
+}
+
+
+std::string decryptOffset(std::string_view input) {
+    std::string decrypted(input);
+    applyOffsetCipher(decrypted.data(), decrypted.length(), true);
+    return decrypted;
+}
+
+
+bool offsetKernelSupported(enum OffsetKernel kernel) {
+#ifdef OFFSET_CIPHER_X86
+    if (kernel == OFFSET_KERNEL_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (kernel == OFFSET_KERNEL_SSE2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return kernel == OFFSET_KERNEL_SCALAR;
+}
+
+
+enum OffsetKernel bestOffsetKernel() {
+    static const enum OffsetKernel best = offsetKernelSupported(OFFSET_KERNEL_AVX2) ? OFFSET_KERNEL_AVX2 :
+                                          offsetKernelSupported(OFFSET_KERNEL_SSE2) ? OFFSET_KERNEL_SSE2 :
+                                          OFFSET_KERNEL_SCALAR;
+    return best;
+}
+
+
+const char *offsetKernelName(enum OffsetKernel kernel) {
+    switch (kernel) {
+    case OFFSET_KERNEL_AVX2:
+        return "avx2";
+    case OFFSET_KERNEL_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef OFFSETCIPHER_H
+#define OFFSETCIPHER_H
+
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+
+// The offset cipher of login credentials: encrypting shifts every digit by OFFSET_CIPHER_SHIFT cyclically within
+// 0-9 and every letter within a-z or A-Z (keeping its case); other bytes stay as they are. Decrypting shifts back.
+// Bytes are transformed by kernels that take 32 (AVX2) or 16 (SSE2) bytes per step, adding a per-byte shift built
+// from compares and masks instead of branching on each character, with a scalar loop for the tail; the best
+// kernel the CPU supports is picked at the first call.
+#define OFFSET_CIPHER_SHIFT 3
+
+
+enum OffsetKernel {
+    OFFSET_KERNEL_SCALAR,
+    OFFSET_KERNEL_SSE2,
+    OFFSET_KERNEL_AVX2,
+};
+
+
+/**
+ * Encrypt or decrypt bytes in place, e.g. a whole encrypted member file
+ * @param data bytes
+ * @param len number of bytes
+ * @param decrypt shift back instead of forward
+ */
+void applyOffsetCipher(char *data, size_t len, bool decrypt);
+
+
+/**
+ * Encrypt or decrypt bytes in place with a given kernel, e.g. to compare kernels
+ * @param kernel the kernel; one the CPU supports
+ * @param data bytes
+ * @param len number of bytes
+ * @param decrypt shift back instead of forward
+ */
+void applyOffsetCipherWith(enum OffsetKernel kernel, char *data, size_t len, bool decrypt);
+
+
+/**
+ * @param input original string
+ * @return encrypted string
+ */
+std::string encryptOffset(std::string_view input);
+
+
+/**
+ * @param input encrypted string
+ * @return decrypted string
+ */
+std::string decryptOffset(std::string_view input);
+
+
+/**
+ * @param kernel a kernel
+ * @return whether the CPU (and the build's target architecture) supports it
+ */
+bool offsetKernelSupported(enum OffsetKernel kernel);
+
+
+/**
+ * @return the fastest kernel the CPU supports, the one applyOffsetCipher() uses
+ */
+enum OffsetKernel bestOffsetKernel();
+
+
+/**
+ * @param kernel a kernel
+ * @return its name, e.g. "avx2"
+ */
+const char *offsetKernelName(enum OffsetKernel kernel);
+
+
+#endif //OFFSETCIPHER_H
@@ -0,0 +1,433 @@
+#include "room_index.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/**
+ * FNV-1a hash of a room layout code
+ * @param roomcode room layout code
+ * @return hash
+ */
+uint32_t RoomIndex::hashOf(std::string_view roomcode) {
+    uint32_t hash = 2166136261u;
+    for (char c : roomcode) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * FNV-1a over 32-bit words, the checksum of room table files
+ * @param data bytes, 4-byte aligned
+ * @param len number of bytes, a multiple of 4
+ * @return checksum
+ */
+static uint32_t checksumOf(const char *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    const uint32_t *words = (const uint32_t *)data;
+    for (size_t i = 0; i < len / 4; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Round a file offset up to the next section boundary
+ * @param offset file offset
+ * @return offset rounded up to a multiple of 8
+ */
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+
+RoomIndex::RoomIndex() {
+    syncViews();
+}
+
+
+RoomIndex::RoomIndex(const RoomIndex& other) {
+    // a copy of a mapped table is owned
+    slots.assign(other.slotView, other.slotView + other.numSlots);
+    offsets.assign(other.offsetView, other.offsetView + other.numRooms + 1);
+    bytes.assign(other.byteView, other.byteView + other.offsetView[other.numRooms]);
+    counts.assign(other.countView, other.countView + other.numRooms);
+    syncViews();
+}
+
+
+RoomIndex::RoomIndex(RoomIndex&& other) noexcept {
+    takeFrom(other);
+}
+
+
+RoomIndex& RoomIndex::operator=(RoomIndex other) noexcept {
+    unmap();
+    takeFrom(other);
+    return *this;
+}
+
+
+RoomIndex::~RoomIndex() {
+    unmap();
+}
+
+
+/**
+ * Take over the storage of another table, leaving it empty
+ * @param other table to take from
+ */
+void RoomIndex::takeFrom(RoomIndex& other) noexcept {
+    slots = std::move(other.slots);
+    offsets = std::move(other.offsets);
+    bytes = std::move(other.bytes);
+    counts = std::move(other.counts);
+    mapping = other.mapping;
+    mappingLen = other.mappingLen;
+    if (mapping != nullptr) {
+        slotView = other.slotView;
+        numSlots = other.numSlots;
+        offsetView = other.offsetView;
+        byteView = other.byteView;
+        countView = other.countView;
+        numRooms = other.numRooms;
+    } else {
+        syncViews();
+    }
+    other.mapping = nullptr;
+    other.slots.clear();
+    other.offsets.assign(1, 0);
+    other.bytes.clear();
+    other.counts.clear();
+    other.syncViews();
+}
+
+
+/**
+ * Point the views at the owned arrays, after they changed
+ */
+void RoomIndex::syncViews() {
+    slotView = slots.data();
+    numSlots = slots.size();
+    offsetView = offsets.data();
+    byteView = bytes.data();
+    countView = counts.data();
+    numRooms = counts.size();
+}
+
+
+/**
+ * Release the mapped room table file, if any; the views are left dangling
+ */
+void RoomIndex::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingLen);
+        mapping = nullptr;
+    }
+}
+
+
+/**
+ * Copy a mapped table into owned storage, so it can grow
+ */
+void RoomIndex::copyToOwned() {
+    if (mapping == nullptr) {
+        return;
+    }
+    slots.assign(slotView, slotView + numSlots);
+    offsets.assign(offsetView, offsetView + numRooms + 1);
+    bytes.assign(byteView, byteView + offsetView[numRooms]);
+    counts.assign(countView, countView + numRooms);
+    unmap();
+    syncViews();
+}
+
+
+/**
+ * Rebuild the hash table with a given number of slots
+ * @param numSlots number of slots, a power of two
+ */
+void RoomIndex::rehash(size_t numSlots) {
+    slots.assign(numSlots, Slot{0, ROOM_NOT_FOUND});
+    size_t mask = numSlots - 1;
+    for (uint32_t id = 0; id < counts.size(); id++) {
+        uint32_t hash = hashOf(code(id));
+        size_t i = hash & mask;
+        while (slots[i].id != ROOM_NOT_FOUND) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = Slot{hash, id};
+    }
+    syncViews();
+}
+
+
+void RoomIndex::reserve(size_t numRooms) {
+    copyToOwned();
+    size_t numSlots = 16;
+    while (numSlots * 3 / 4 < numRooms) {
+        numSlots *= 2;
+    }
+    if (numSlots > slots.size()) {
+        rehash(numSlots);
+    }
+    offsets.reserve(numRooms + 1);
+    counts.reserve(numRooms);
+    syncViews();
+}
+
+
+uint32_t RoomIndex::find(std::string_view roomcode) const {
+    if (numSlots == 0) {
+        return ROOM_NOT_FOUND;
+    }
+    uint32_t hash = hashOf(roomcode);
+    size_t mask = numSlots - 1;
+    for (size_t i = hash & mask; slotView[i].id != ROOM_NOT_FOUND; i = (i + 1) & mask) {
+        if (slotView[i].hash == hash && code(slotView[i].id) == roomcode) {
+            return slotView[i].id;
+        }
+    }
+    return ROOM_NOT_FOUND;
+}
+
+
+uint32_t RoomIndex::insert(std::string_view roomcode) {
+    if (mapping != nullptr) {
+        uint32_t id = find(roomcode);
+        if (id != ROOM_NOT_FOUND) {
+            return id;
+        }
+        copyToOwned();
+    }
+    if ((counts.size() + 1) * 4 > slots.size() * 3) {
+        rehash(std::max<size_t>(16, slots.size() * 2));
+    }
+    uint32_t hash = hashOf(roomcode);
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    for (; slots[i].id != ROOM_NOT_FOUND; i = (i + 1) & mask) {
+        if (slots[i].hash == hash && code(slots[i].id) == roomcode) {
+            return slots[i].id;
+        }
+    }
+    uint32_t id = counts.size();
+    slots[i] = Slot{hash, id};
+    bytes.insert(bytes.end(), roomcode.begin(), roomcode.end());
+    offsets.push_back(bytes.size());
+    counts.push_back(0);
+    syncViews();
+    return id;
+}
+
+
+bool RoomIndex::save(const std::string& path, uint64_t lsn, const std::vector<int>& held) const {
+    struct Header header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, ROOM_TABLE_MAGIC, 4);
+    header.version = ROOM_TABLE_VERSION;
+    header.lsn = lsn;
+    header.numRooms = numRooms;
+    header.numSlots = numSlots;
+    header.numBytes = offsetView[numRooms];
+    header.slotsAt = align8(sizeof header);
+    header.offsetsAt = align8(header.slotsAt + numSlots * sizeof(Slot));
+    header.bytesAt = align8(header.offsetsAt + (numRooms + 1) * sizeof(uint32_t));
+    header.countsAt = align8(header.bytesAt + header.numBytes);
+    header.fileLen = align8(header.countsAt + numRooms * sizeof(int32_t));
+
+    std::string content(header.fileLen, '\0');
+    char *data = content.data();
+    memcpy(data + header.slotsAt, slotView, numSlots * sizeof(Slot));
+    memcpy(data + header.offsetsAt, offsetView, (numRooms + 1) * sizeof(uint32_t));
+    memcpy(data + header.bytesAt, byteView, header.numBytes);
+    int32_t *fileCounts = (int32_t *)(data + header.countsAt);
+    for (size_t id = 0; id < numRooms; id++) {
+        fileCounts[id] = countView[id] + (id < held.size() ? held[id] : 0);
+    }
+    header.bodyChecksum = checksumOf(data + header.slotsAt, header.fileLen - header.slotsAt);
+    header.headerChecksum = checksumOf((const char *)&header, offsetof(Header, headerChecksum));
+    memcpy(data, &header, sizeof header);
+
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(("open " + tmpPath).c_str());
+        return false;
+    }
+    size_t done = 0;
+    while (done < content.length()) {
+        ssize_t numbytes = write(fd, data + done, content.length() - done);
+        if (numbytes == -1) {
+            perror("write");
+            close(fd);
+            return false;
+        }
+        done += numbytes;
+    }
+    if (fsync(fd) == -1) {
+        perror("fsync");
+        close(fd);
+        return false;
+    }
+    close(fd);
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        perror("rename");
+        return false;
+    }
+    return true;
+}
+
+
+bool RoomIndex::map(const std::string& path, uint64_t& lsn) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || (size_t)fileStat.st_size < sizeof(Header)) {
+        close(fd);
+        fprintf(stderr, "%s: not a room table\n", path.c_str());
+        return false;
+    }
+    size_t len = fileStat.st_size;
+    // private and writable: the counts change in memory only
+    void *mapped = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(("mmap " + path).c_str());
+        return false;
+    }
+
+    const char *data = (const char *)mapped;
+    struct Header header;
+    memcpy(&header, data, sizeof header);
+    bool valid = memcmp(header.magic, ROOM_TABLE_MAGIC, 4) == 0 && header.version == ROOM_TABLE_VERSION &&
+        header.headerChecksum == checksumOf(data, offsetof(Header, headerChecksum)) && header.fileLen == len &&
+        // every size and offset within the file before any is multiplied or added, so nothing below wraps around
+        header.numRooms < ROOM_NOT_FOUND && header.numRooms <= len / sizeof(uint32_t) &&
+        header.numSlots <= len / sizeof(Slot) && header.numBytes <= len && header.slotsAt <= len &&
+        header.offsetsAt <= len && header.bytesAt <= len && header.countsAt <= len &&
+        (header.numSlots & (header.numSlots - 1)) == 0 &&
+        header.numRooms * 4 <= header.numSlots * 3 &&
+        header.slotsAt >= sizeof header && header.slotsAt % 8 == 0 && header.offsetsAt % 8 == 0 &&
+        header.bytesAt % 8 == 0 && header.countsAt % 8 == 0 &&
+        header.offsetsAt >= header.slotsAt + header.numSlots * sizeof(Slot) &&
+        header.bytesAt >= header.offsetsAt + (header.numRooms + 1) * sizeof(uint32_t) &&
+        header.countsAt >= header.bytesAt + header.numBytes &&
+        len >= header.countsAt + header.numRooms * sizeof(int32_t);
+    if (!valid) {
+        munmap(mapped, len);
+        fprintf(stderr, "%s: corrupt or unsupported room table\n", path.c_str());
+        return false;
+    }
+    if (!checkSections(data, header, path)) {
+        munmap(mapped, len);
+        return false;
+    }
+    const uint32_t *fileOffsets = (const uint32_t *)(data + header.offsetsAt);
+
+    unmap();
+    slots.clear();
+    slots.shrink_to_fit();
+    offsets.assign(1, 0);
+    offsets.shrink_to_fit();
+    bytes.clear();
+    bytes.shrink_to_fit();
+    counts.clear();
+    counts.shrink_to_fit();
+    mapping = mapped;
+    mappingLen = len;
+    slotView = (const Slot *)(data + header.slotsAt);
+    numSlots = header.numSlots;
+    offsetView = fileOffsets;
+    byteView = data + header.bytesAt;
+    countView = (int *)(data + header.countsAt);
+    numRooms = header.numRooms;
+    lsn = header.lsn;
+    return true;
+}
+
+
+/**
+ * Check the sections of a room table file whose header is valid: their checksum, and what lookups rely on to stay
+ * within the file and to end: code offsets that never go down, slot IDs below the number of rooms, and at least
+ * one empty slot to stop a probe
+ * @param data the mapped file
+ * @param header its header
+ * @param path room table file path, for messages
+ * @return whether the sections are valid
+ */
+bool RoomIndex::checkSections(const char *data, const Header& header, const std::string& path) {
+    if (header.bodyChecksum != checksumOf(data + header.slotsAt, header.fileLen - header.slotsAt)) {
+        fprintf(stderr, "%s: checksum mismatch\n", path.c_str());
+        return false;
+    }
+    const uint32_t *fileOffsets = (const uint32_t *)(data + header.offsetsAt);
+    if (fileOffsets[0] != 0 || fileOffsets[header.numRooms] != header.numBytes) {
+        fprintf(stderr, "%s: corrupt or unsupported room table\n", path.c_str());
+        return false;
+    }
+    for (size_t id = 0; id < header.numRooms; id++) {
+        if (fileOffsets[id] > fileOffsets[id + 1]) {
+            fprintf(stderr, "%s: room %zu has a bad code offset\n", path.c_str(), id);
+            return false;
+        }
+    }
+    const Slot *fileSlots = (const Slot *)(data + header.slotsAt);
+    size_t numEmpty = 0;
+    for (size_t i = 0; i < header.numSlots; i++) {
+        uint32_t id = fileSlots[i].id;
+        if (id != ROOM_NOT_FOUND && id >= header.numRooms) {
+            fprintf(stderr, "%s: slot %zu is inconsistent\n", path.c_str(), i);
+            return false;
+        }
+        numEmpty += id == ROOM_NOT_FOUND;
+    }
+    if (header.numSlots > 0 && numEmpty == 0) {
+        fprintf(stderr, "%s: no empty slot\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool RoomIndex::verify(const std::string& path) {
+    RoomIndex table;
+    uint64_t lsn;
+    if (!table.map(path, lsn)) { // checks the checksum, the code offsets and the slot IDs
+        return false;
+    }
+    size_t numUsed = 0;
+    for (size_t i = 0; i < table.numSlots; i++) {
+        uint32_t id = table.slotView[i].id;
+        if (id != ROOM_NOT_FOUND && table.slotView[i].hash != hashOf(table.code(id))) {
+            fprintf(stderr, "%s: slot %zu is inconsistent\n", path.c_str(), i);
+            return false;
+        }
+        numUsed += id != ROOM_NOT_FOUND;
+    }
+    for (uint32_t id = 0; id < table.numRooms; id++) {
+        if (table.find(table.code(id)) != id) {
+            fprintf(stderr, "%s: room %u cannot be found\n", path.c_str(), id);
+            return false;
+        }
+    }
+    return numUsed == table.numRooms;
+}
+
+
+std::string RoomIndex::toStr() const {
+    std::string res;
+    for (uint32_t id = 0; id < numRooms; id++) {
+        res += std::string(code(id)) + "," + std::to_string(countView[id]) + "\n";
+    }
+    return res;
+}
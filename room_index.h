@@ -0,0 +1,237 @@
+#ifndef ROOMINDEX_H
+#define ROOMINDEX_H
+
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// Room availability table. Room codes are interned into compact integer IDs (0, 1, 2, ... in insertion order);
+// codes (back to back in one byte array, with an array of offsets) and counts are stored in contiguous arrays
+// indexed by ID, and an open-addressing hash table with linear probing maps a code to its ID. A slot keeps the
+// code's hash next to the ID, so a probe only compares strings when the hashes match.
+//
+// The same arrays make up a room table file, which a table can memory-map and use as is (the counts are mapped
+// copy-on-write, so changes stay in memory). Integers are in host byte order; every section starts 8-byte aligned.
+//   header:  char[4] "RTAB", uint32 version, uint64 lsn (of the last write-ahead log record included, 0 if none),
+//            uint64 number of rooms, uint64 number of slots, uint64 number of code bytes,
+//            uint64 file offsets of the slot, code offset, code byte and count sections, uint64 file length,
+//            uint32 checksum of the sections, uint32 checksum of the header before it
+//   slots:   {uint32 hash, uint32 ID} per slot
+//   offsets: uint32 per room, plus one: where each code starts in the code bytes, and where the last one ends
+//   bytes:   the room layout codes, back to back
+//   counts:  int32 per room
+// Checksums are FNV-1a over 32-bit words. Mapping checks the header, the checksum of the sections and what lookups
+// rely on (slot IDs in range, at least one empty slot, code offsets in order), so a torn or corrupt file is
+// rejected instead of being read out of bounds; verify() also checks every slot's hash and every lookup.
+#define ROOM_NOT_FOUND UINT32_MAX
+#define ROOM_TABLE_MAGIC "RTAB"
+#define ROOM_TABLE_VERSION 1
+
+
+class RoomIndex {
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t id; // ROOM_NOT_FOUND if the slot is empty
+    };
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t lsn;
+        uint64_t numRooms, numSlots, numBytes;
+        uint64_t slotsAt, offsetsAt, bytesAt, countsAt, fileLen;
+        uint32_t bodyChecksum, headerChecksum;
+    };
+
+    // owned storage, unless the table is mapped from a room table file
+    std::vector<Slot> slots; // the number of slots is a power of two, at most 3/4 full
+    std::vector<uint32_t> offsets = {0}; // ID: where its room layout code starts in bytes; plus the end of the last one
+    std::vector<char> bytes; // room layout codes, back to back
+    std::vector<int> counts; // ID: number of available rooms
+
+    // what lookups use: the owned arrays, or the sections of the mapped file
+    const Slot *slotView = nullptr;
+    size_t numSlots = 0;
+    const uint32_t *offsetView = nullptr;
+    const char *byteView = nullptr;
+    int *countView = nullptr;
+    size_t numRooms = 0;
+    void *mapping = nullptr; // the mapped room table file, if any
+    size_t mappingLen = 0;
+
+    static uint32_t hashOf(std::string_view roomcode);
+    static bool checkSections(const char *data, const Header& header, const std::string& path);
+    void rehash(size_t numSlots);
+    void syncViews();
+    void unmap();
+    void copyToOwned();
+    void takeFrom(RoomIndex& other) noexcept;
+
+public:
+    RoomIndex();
+    RoomIndex(const RoomIndex& other);
+    RoomIndex(RoomIndex&& other) noexcept;
+    RoomIndex& operator=(RoomIndex other) noexcept;
+    ~RoomIndex();
+
+
+    /**
+     * Make room for a number of room layouts, so inserting them does not rehash
+     * @param numRooms number of room layouts
+     */
+    void reserve(size_t numRooms);
+
+
+    /**
+     * Look up the ID of a room layout
+     * @param roomcode room layout code
+     * @return ID, or ROOM_NOT_FOUND
+     */
+    uint32_t find(std::string_view roomcode) const;
+
+
+    /**
+     * Intern a room layout code; a new room layout starts with 0 available rooms.
+     * A mapped table is copied to owned storage before its first new room layout.
+     * @param roomcode room layout code
+     * @return ID of the room layout
+     */
+    uint32_t insert(std::string_view roomcode);
+
+
+    /**
+     * Store the number of available rooms of a room layout, adding the room layout if it is new
+     * @param roomcode room layout code
+     * @param numAvailable available number
+     */
+    void assign(std::string_view roomcode, int numAvailable) {
+        uint32_t id = insert(roomcode);
+        countView[id] = numAvailable;
+    }
+
+
+    /**
+     * @param id ID of a room layout
+     * @return its number of available rooms
+     */
+    int& count(uint32_t id) {
+        return countView[id];
+    }
+    int count(uint32_t id) const {
+        return countView[id];
+    }
+
+
+    /**
+     * Read a count atomically, while other threads may change counts with takeOne() and giveOne()
+     * @param id ID of a room layout
+     * @return its number of available rooms
+     */
+    int load(uint32_t id) const {
+        return __atomic_load_n(&countView[id], __ATOMIC_RELAXED);
+    }
+
+
+    /**
+     * Set a count atomically, while other threads may read it with load()
+     * @param id ID of a room layout
+     * @param numAvailable available number
+     */
+    void store(uint32_t id, int numAvailable) {
+        __atomic_store_n(&countView[id], numAvailable, __ATOMIC_RELAXED);
+    }
+
+
+    /**
+     * Take one room if any is available, without a lock: a compare-and-swap loop decrements the count only if it
+     * is still the positive value it read, so concurrent callers never take more rooms than there are
+     * @param id ID of a room layout
+     * @return the new available number, or -1 if no room was available
+     */
+    int takeOne(uint32_t id) {
+        int numAvailable = __atomic_load_n(&countView[id], __ATOMIC_RELAXED);
+        while (numAvailable > 0) {
+            // on failure, numAvailable is reloaded with the current count
+            if (__atomic_compare_exchange_n(&countView[id], &numAvailable, numAvailable - 1, true,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return numAvailable - 1;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Give one room back atomically
+     * @param id ID of a room layout
+     * @return the new available number
+     */
+    int giveOne(uint32_t id) {
+        return __atomic_add_fetch(&countView[id], 1, __ATOMIC_ACQ_REL);
+    }
+
+
+    /**
+     * @param id ID of a room layout
+     * @return its room layout code
+     */
+    std::string_view code(uint32_t id) const {
+        return std::string_view(byteView + offsetView[id], offsetView[id + 1] - offsetView[id]);
+    }
+
+
+    /**
+     * @return number of room layouts; their IDs are 0 to size() - 1
+     */
+    size_t size() const {
+        return numRooms;
+    }
+
+
+    /**
+     * @return whether the table is a mapped room table file
+     */
+    bool isMapped() const {
+        return mapping != nullptr;
+    }
+
+
+    /**
+     * Write the table as a room table file: to a temporary file, fsync'ed, then renamed over the path
+     * @param path room table file path
+     * @param lsn lsn of the last write-ahead log record the table includes, 0 if none
+     * @param held rooms to add to each count (by ID), e.g. rooms held but not reserved yet; may be shorter than the table
+     * @return whether successful or not
+     */
+    bool save(const std::string& path, uint64_t lsn = 0, const std::vector<int>& held = {}) const;
+
+
+    /**
+     * Replace the table with a memory-mapped room table file, checking its header and its sections
+     * @param path room table file path
+     * @param lsn to store the lsn of the last write-ahead log record the file includes
+     * @return whether successful; false if there is no valid room table file, leaving the table unchanged
+     */
+    bool map(const std::string& path, uint64_t& lsn);
+
+
+    /**
+     * Check the checksum of a room table file and that its slots and offsets are consistent
+     * @param path room table file path
+     * @return whether the file is a valid room table
+     */
+    static bool verify(const std::string& path);
+
+
+    /**
+     * turn the table to a printable string in ID order, convert each entry to "key,value\n"
+     * @return
+     */
+    std::string toStr() const;
+};
+
+
+#endif //ROOMINDEX_H
@@ -0,0 +1,206 @@
+#include "room_log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+
+
+/**
+ * FNV-1a hash of a byte range
+ * @param data bytes
+ * @param len number of bytes
+ * @return hash
+ */
+static uint32_t checksumOf(const char *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Append an integer in host byte order
+ * @param out output buffer
+ * @param value integer
+ */
+template <typename T>
+static void appendInt(std::string& out, T value) {
+    out.append((const char *)&value, sizeof value);
+}
+
+
+/**
+ * Read an integer in host byte order, and advance the position
+ * @param data buffer
+ * @param len number of bytes in the buffer
+ * @param pos position to read at
+ * @param value to store the integer
+ * @return whether the buffer holds the integer
+ */
+template <typename T>
+static bool readInt(const char *data, size_t len, size_t& pos, T& value) {
+    if (len - pos < sizeof value) {
+        return false;
+    }
+    memcpy(&value, data + pos, sizeof value);
+    pos += sizeof value;
+    return true;
+}
+
+
+/**
+ * Read a whole file
+ * @param path file path
+ * @param content to store the content
+ * @return whether successful; false if the file does not exist
+ */
+static bool readFile(const std::string& path, std::string& content) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    off_t len = lseek(fd, 0, SEEK_END);
+    if (len == -1) {
+        close(fd);
+        return false;
+    }
+    content.resize(len);
+    size_t done = 0;
+    while (done < (size_t)len) {
+        ssize_t numbytes = pread(fd, content.data() + done, len - done, done);
+        if (numbytes <= 0) {
+            close(fd);
+            return false;
+        }
+        done += numbytes;
+    }
+    close(fd);
+    return true;
+}
+
+
+WriteAheadLog::~WriteAheadLog() {
+    if (fd != -1) {
+        commit();
+        sync();
+        close(fd);
+    }
+}
+
+
+long WriteAheadLog::open(const std::string& path, long fsyncIntervalMs, RoomIndex& rooms, uint64_t snapshotLsn) {
+    this->fsyncIntervalMs = fsyncIntervalMs;
+    nextLsn = snapshotLsn + 1;
+    std::string content;
+    readFile(path, content);
+
+    // replay complete records; the first torn or corrupt one ends the log
+    long numApplied = 0;
+    size_t pos = 0;
+    while (pos < content.length()) {
+        size_t start = pos;
+        uint64_t lsn;
+        uint16_t length;
+        int32_t delta;
+        uint32_t checksum;
+        if (!readInt(content.data(), content.length(), pos, lsn) ||
+            !readInt(content.data(), content.length(), pos, length) || content.length() - pos < length) {
+            break;
+        }
+        std::string_view roomcode(content.data() + pos, length);
+        pos += length;
+        size_t end = pos;
+        if (!readInt(content.data(), content.length(), pos, delta) ||
+            !readInt(content.data(), content.length(), pos, checksum) ||
+            checksum != checksumOf(content.data() + start, end + sizeof delta - start)) {
+            pos = start;
+            break;
+        }
+        numRecords++;
+        if (lsn > snapshotLsn) {
+            rooms.count(rooms.insert(roomcode)) += delta;
+            nextLsn = lsn + 1;
+            numApplied++;
+        }
+    }
+    if (pos < content.length()) {
+        fprintf(stderr, "%s: ignoring %zu bytes after the last complete record\n", path.c_str(),
+                content.length() - pos);
+    }
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    // cut off a torn tail, so new records follow the last complete one
+    if (ftruncate(fd, pos) == -1 || lseek(fd, pos, SEEK_SET) == -1) {
+        perror("ftruncate");
+        return -1;
+    }
+    lastSync = std::chrono::steady_clock::now();
+    return numApplied;
+}
+
+
+void WriteAheadLog::append(std::string_view roomcode, int delta) {
+    size_t start = buffer.length();
+    appendInt<uint64_t>(buffer, nextLsn++);
+    appendInt<uint16_t>(buffer, roomcode.length());
+    buffer.append(roomcode.data(), roomcode.length());
+    appendInt<int32_t>(buffer, delta);
+    appendInt<uint32_t>(buffer, checksumOf(buffer.data() + start, buffer.length() - start));
+    numRecords++;
+}
+
+
+bool WriteAheadLog::commit() {
+    size_t done = 0;
+    while (done < buffer.length()) {
+        ssize_t numbytes = write(fd, buffer.data() + done, buffer.length() - done);
+        if (numbytes == -1) {
+            perror("write");
+            return false;
+        }
+        done += numbytes;
+    }
+    if (!buffer.empty()) {
+        buffer.clear();
+        unsynced = true;
+    }
+    if (unsynced && (fsyncIntervalMs == 0 ||
+        (fsyncIntervalMs > 0 && std::chrono::steady_clock::now() >= syncDeadline()))) {
+        return sync();
+    }
+    return true;
+}
+
+
+bool WriteAheadLog::sync() {
+    if (!unsynced || fsyncIntervalMs < 0) {
+        return true;
+    }
+    if (fdatasync(fd) == -1) {
+        perror("fdatasync");
+        return false;
+    }
+    unsynced = false;
+    lastSync = std::chrono::steady_clock::now();
+    return true;
+}
+
+
+bool WriteAheadLog::truncate() {
+    if (!commit()) {
+        return false;
+    }
+    if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+        perror("ftruncate");
+        return false;
+    }
+    numRecords = 0;
+    unsynced = false;
+    return true;
+}
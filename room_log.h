@@ -0,0 +1,113 @@
+#ifndef ROOMLOG_H
+#define ROOMLOG_H
+
+
+#include "room_index.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+
+// Durability of a backend server's room counts: an append-only write-ahead log of reservation deltas, plus
+// snapshots of the whole room table, which are room table files (see room_index.h) recording the lsn of the last
+// log record they include. A restart maps the latest snapshot and replays the log records after it.
+// Integers are in host byte order; the files are only read back on the machine that wrote them.
+//
+// Log record:
+//   uint64 lsn         log sequence number, increasing by 1 per record
+//   uint16 length      length of the roomcode
+//   char[length]       roomcode
+//   int32  delta       change of the room's count
+//   uint32 checksum    FNV-1a of the bytes above; a record with a wrong checksum ends the log (a torn write)
+
+
+class WriteAheadLog {
+private:
+    int fd = -1;
+    std::string buffer; // records appended since the last commit
+    uint64_t nextLsn = 1;
+    long numRecords = 0; // records in the log file
+    long fsyncIntervalMs = 0; // 0: fdatasync on every commit, > 0: at most every this many ms, < 0: never
+    bool unsynced = false; // written but not fdatasync'ed yet
+    std::chrono::steady_clock::time_point lastSync;
+
+public:
+    ~WriteAheadLog();
+
+
+    /**
+     * Replay the records of a log file after a snapshot, and open the file for appending.
+     * A torn record at the end (from a crash in the middle of a write) is cut off.
+     * @param path log file path
+     * @param fsyncIntervalMs 0: fdatasync on every commit, > 0: at most every this many ms, < 0: never
+     * @param rooms room table to apply the records to
+     * @param snapshotLsn lsn of the last record included in the loaded snapshot, 0 if none
+     * @return number of records applied, or -1 on errors
+     */
+    long open(const std::string& path, long fsyncIntervalMs, RoomIndex& rooms, uint64_t snapshotLsn);
+
+
+    /**
+     * Append a record to the in-memory buffer; it becomes durable with the next commit()
+     * @param roomcode room layout code
+     * @param delta change of the room's count
+     */
+    void append(std::string_view roomcode, int delta);
+
+
+    /**
+     * Write the buffered records with one write() (group commit), and fdatasync the written records once the
+     * fsync interval allows
+     * @return whether successful or not
+     */
+    bool commit();
+
+
+    /**
+     * fdatasync records written but not synced yet
+     * @return whether successful or not
+     */
+    bool sync();
+
+
+    /**
+     * @return whether written records wait for the fsync interval to pass
+     */
+    bool syncPending() const {
+        return unsynced && fsyncIntervalMs > 0;
+    }
+
+    /**
+     * @return when the records waiting for the fsync interval are due to be synced
+     */
+    std::chrono::steady_clock::time_point syncDeadline() const {
+        return lastSync + std::chrono::milliseconds(fsyncIntervalMs);
+    }
+
+
+    /**
+     * Empty the log file once a snapshot includes all of its records; sequence numbers keep increasing
+     * @return whether successful or not
+     */
+    bool truncate();
+
+
+    /**
+     * @return lsn of the last appended record, 0 if none
+     */
+    uint64_t lastLsn() const {
+        return nextLsn - 1;
+    }
+
+    /**
+     * @return number of records in the log file
+     */
+    long size() const {
+        return numRecords;
+    }
+};
+
+
+#endif //ROOMLOG_H
@@ -0,0 +1,45 @@
+#include "server_utils.h"
+using namespace std;
+
+
+// Converts a text room inventory (single.txt, double.txt, suite.txt) to a room table file, which backend servers
+// memory-map at startup instead of parsing the text file.
+// Usage: ./roomtab <input.txt> [output.rtab]    (the output defaults to the input with the extension .rtab)
+//        ./roomtab -c <table.rtab>               checks a room table file
+
+
+int main(int argc, char *argv[]) {
+    bool check = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        if (opt == 'c') {
+            check = true;
+        }
+        else {
+            optind = argc + 1; // print the usage
+            break;
+        }
+    }
+    if (optind >= argc || argc - optind > (check ? 1 : 2)) {
+        cerr << "Usage: " << argv[0] << " <input.txt> [output.rtab]" << endl;
+        cerr << "       " << argv[0] << " -c <table.rtab>" << endl;
+        return 1;
+    }
+
+    if (check) {
+        if (!RoomIndex::verify(argv[optind])) {
+            return 1;
+        }
+        cout << argv[optind] << " is a valid room table." << endl;
+        return 0;
+    }
+
+    string input = argv[optind];
+    string output = optind + 1 < argc ? argv[optind + 1] : tableFileOf(input);
+    RoomIndex rooms;
+    if (!loadRoomFile(input, rooms) || !rooms.save(output)) {
+        return 1;
+    }
+    cout << "Converted " << rooms.size() << " rooms from " << input << " to " << output << "." << endl;
+    return 0;
+}
@@ -9,55 +9,482 @@ struct LoginStatus {
     bool isMember;
 };
 
-class MainServer {
+// wire protocol of a client connection, decided by the first byte the client sends
+enum WireProtocol {
+    WIRE_UNDECIDED,
+    WIRE_TEXT, // newline-separated text messages
+    WIRE_BINARY, // length-prefixed binary frames, see binary_protocol.h
+};
+
+// per-connection state kept by the event loop
+struct ClientConnection {
+    uint64_t connectionId; // unique per reactor, tells a reused child sockfd apart from the connection it replaced
+    enum WireProtocol protocol;
+    struct LoginStatus loginStatus;
+    std::string inBuf; // received bytes not yet forming a complete message
+    std::string outBuf; // reply bytes not yet accepted by send()
+};
+
+// progress of the chunked INIT transfer from one backend server
+struct InitTransfer {
+    std::string transferId; // a backend server starts a new transfer (e.g. after a restart) with a new ID
+    std::vector<bool> received; // which chunks have been applied
+    size_t numReceived;
+    size_t numRooms;
+    std::chrono::steady_clock::time_point start;
+};
+
+// a request forwarded to a backend server and waiting for its reply
+struct InflightRequest {
+    int childSockfd; // the client that originates the request
+    uint64_t connectionId;
+    std::string seq; // the client's sequence number of the request, echoed in the reply
+    std::string backendServerName;
+    std::string roomcode;
+    uint64_t batchId; // the CHB/REB request this is a part of, 0 if none
+    std::vector<size_t> batchIndexes; // positions of the part's roomcodes in the batch
+    std::string msg; // the datagram sent to the backend server, kept for retransmission
+    int retransmits;
+    std::chrono::steady_clock::time_point deadline;
+    // a COM is retransmitted past MAX_RETRANSMITS until then: the hold it commits may still exist
+    std::chrono::steady_clock::time_point retransmitUntil;
+};
+
+// a CHB/REB request of a client, split into one request per backend server
+struct BatchRequest {
+    int childSockfd;
+    uint64_t connectionId;
+    std::string op; // MSG_CHECK_BATCH or MSG_RESERVE_BATCH
+    std::string seq;
+    std::vector<std::string> roomcodes;
+    std::vector<std::string> results; // result op code per roomcode, in request order
+    std::map<std::string, std::vector<size_t>> parts; // backend server name: positions of its roomcodes
+    size_t numPending; // parts not answered yet in the current phase
+    std::string txid; // transaction ID of a group reservation
+    int phase; // of a group reservation: 1 while preparing, 2 while committing
+};
+
+
+/**
+ * In-flight backend requests of one reactor, keyed by a 64-bit request ID.
+ * Requests live in a slab of reusable slots; a request ID is (reactor id | slot generation | slot index),
+ * so insert, lookup and erase are O(1), and a stale ID (of a request already answered or given up) never
+ * matches the slot's next occupant.
+ */
+class InflightTable {
+private:
+    struct Slot {
+        uint32_t generation;
+        bool inUse;
+        struct InflightRequest request;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    uint64_t idPrefix; // reactor id in the highest 8 bits (so at most MAX_REACTORS reactors)
+
+public:
+    explicit InflightTable(int reactorId) {
+        idPrefix = (uint64_t)reactorId << 56;
+    }
+
+    /**
+     * Store a request
+     * @param request the request
+     * @return its request ID
+     */
+    uint64_t insert(const struct InflightRequest& request) {
+        uint32_t index;
+        if (freeSlots.empty()) {
+            index = slots.size();
+            slots.push_back(Slot{0, false, request});
+        } else {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        Slot& slot = slots[index];
+        slot.generation = (slot.generation + 1) & 0xFFFFFF;
+        slot.inUse = true;
+        slot.request = request;
+        return idPrefix | ((uint64_t)slot.generation << 32) | index;
+    }
+
+    /**
+     * Look up a request
+     * @param requestId request ID
+     * @return the request, or nullptr if the ID is unknown or stale; valid until the next insert
+     */
+    struct InflightRequest *find(uint64_t requestId) {
+        uint32_t index = requestId & 0xFFFFFFFF;
+        if ((requestId & ~0xFFFFFFFFFFFFFFull) != idPrefix || index >= slots.size()) {
+            return nullptr;
+        }
+        Slot& slot = slots[index];
+        if (!slot.inUse || slot.generation != ((requestId >> 32) & 0xFFFFFF)) {
+            return nullptr;
+        }
+        return &slot.request;
+    }
+
+    /**
+     * Remove a request, freeing its slot for reuse
+     * @param requestId request ID
+     */
+    void erase(uint64_t requestId) {
+        if (find(requestId) == nullptr) {
+            return;
+        }
+        uint32_t index = requestId & 0xFFFFFFFF;
+        slots[index].inUse = false;
+        slots[index].request.msg.clear();
+        freeSlots.push_back(index);
+    }
+
+    size_t size() const {
+        return slots.size() - freeSlots.size();
+    }
+};
+
+/**
+ * Room availability data shared by all reactors.
+ * Split into shards with one lock each, so reactors updating different rooms never contend on one global lock.
+ */
+class SharedRoomData {
+private:
+    static const int NUM_SHARDS = 16;
+
+    struct Shard {
+        std::mutex lock;
+        RoomIndex roomData;
+        std::vector<uint64_t> versions; // by room layout ID: update version of the count, 0 if from an INIT
+    };
+    Shard shards[NUM_SHARDS];
+
+    Shard& shardOf(const std::string& roomcode) {
+        return shards[std::hash<std::string>()(roomcode) % NUM_SHARDS];
+    }
+
+public:
+    /**
+     * Store the number of available rooms of a room layout sent by an INIT, forgetting its update version
+     * (a restarted backend server numbers its updates from 1 again)
+     * @param roomcode room layout code
+     * @param numAvailable available number
+     */
+    void set(const std::string& roomcode, int numAvailable) {
+        Shard& shard = shardOf(roomcode);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        uint32_t id = shard.roomData.insert(roomcode);
+        shard.roomData.count(id) = numAvailable;
+        shard.versions.resize(shard.roomData.size());
+        shard.versions[id] = 0;
+    }
+
+
+    /**
+     * Store the number of available rooms of a room layout, unless a count of a later version is stored already.
+     * Versions are compared per room layout, so updates of different room layouts may arrive in any order; counts
+     * of the same version were read after the same changes, so either may be stored.
+     * @param roomcode room layout code
+     * @param numAvailable available number
+     * @param version the backend server's update version when it read the count
+     * @return whether the count was stored
+     */
+    bool set(const std::string& roomcode, int numAvailable, uint64_t version) {
+        Shard& shard = shardOf(roomcode);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        uint32_t id = shard.roomData.insert(roomcode);
+        shard.versions.resize(shard.roomData.size());
+        if (version < shard.versions[id]) {
+            return false;
+        }
+        shard.roomData.count(id) = numAvailable;
+        shard.versions[id] = version;
+        return true;
+    }
+
+    /**
+     * Look up the number of available rooms of a room layout
+     * @param roomcode room layout code
+     * @param numAvailable to store the available number
+     * @return whether the room layout is known
+     */
+    bool get(const std::string& roomcode, int& numAvailable) {
+        Shard& shard = shardOf(roomcode);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        uint32_t id = shard.roomData.find(roomcode);
+        if (id == ROOM_NOT_FOUND) {
+            return false;
+        }
+        numAvailable = shard.roomData.count(id);
+        return true;
+    }
+
+    /**
+     * turn all shards to a printable string, convert each entry to "key,value\n"
+     * @return
+     */
+    std::string toStr() {
+        std::map<std::string, int> merged;
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            for (uint32_t id = 0; id < shard.roomData.size(); id++) {
+                merged[std::string(shard.roomData.code(id))] = shard.roomData.count(id);
+            }
+        }
+        return dataToStr(merged);
+    }
+};
+
+
+/**
+ * Login sessions shared by all reactors: session token: who logged in with it. A client that reconnects sends its
+ * token instead of its username and password, and is logged in by one lookup. A session expires SESSION_TTL_MS
+ * after its login or its last resume. Split into shards with one lock each, like SharedRoomData.
+ */
+class SessionTable {
 private:
+    static const int NUM_SHARDS = 16;
+
+    struct Session {
+        std::string username; // decrypted
+        bool isMember;
+        std::chrono::steady_clock::time_point expiry;
+    };
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<std::string, struct Session> sessions;
+        // (expiry, token) in the order the expiries were set; since every session lives SESSION_TTL_MS, this is
+        // also expiry order. An entry is stale if its session was resumed since, which set a later expiry.
+        std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> expiries;
+    };
+    Shard shards[NUM_SHARDS];
+
+    Shard& shardOf(const std::string& token) {
+        return shards[std::hash<std::string>()(token) % NUM_SHARDS];
+    }
 
-    std::map<std::string, int> allRoomData;
+    /**
+     * Drop the expired sessions of a shard; the caller holds its lock
+     * @param shard shard
+     * @param now current time
+     */
+    static void purge(Shard& shard, std::chrono::steady_clock::time_point now) {
+        while (!shard.expiries.empty() && shard.expiries.front().first <= now) {
+            auto session = shard.sessions.find(shard.expiries.front().second);
+            if (session != shard.sessions.end() && session->second.expiry <= now) {
+                shard.sessions.erase(session);
+            }
+            shard.expiries.pop_front();
+        }
+    }
+
+public:
+    /**
+     * Start a session
+     * @param username decrypted username
+     * @param isMember logged in as a member, not a guest
+     * @return session token, SESSION_TOKEN_BYTES random bytes in hex; empty if no random bytes could be had
+     */
+    std::string create(const std::string& username, bool isMember) {
+        unsigned char random[SESSION_TOKEN_BYTES];
+        if (getrandom(random, sizeof random, 0) != (ssize_t)sizeof random) {
+            perror("getrandom");
+            return "";
+        }
+        static const char digits[] = "0123456789abcdef";
+        std::string token;
+        for (unsigned char byte : random) {
+            token += digits[byte >> 4];
+            token += digits[byte & 0xF];
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto expiry = now + std::chrono::milliseconds(SESSION_TTL_MS);
+        Shard& shard = shardOf(token);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        purge(shard, now);
+        shard.sessions[token] = {username, isMember, expiry};
+        shard.expiries.emplace_back(expiry, token);
+        return token;
+    }
+
+    /**
+     * Resume a session that has not expired, and extend it by SESSION_TTL_MS
+     * @param token session token
+     * @param username to store the decrypted username of the session
+     * @param isMember to store whether the session is a member's
+     * @return whether the session exists and has not expired
+     */
+    bool resume(const std::string& token, std::string& username, bool& isMember) {
+        auto now = std::chrono::steady_clock::now();
+        Shard& shard = shardOf(token);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        purge(shard, now);
+        auto session = shard.sessions.find(token);
+        if (session == shard.sessions.end()) {
+            return false;
+        }
+        session->second.expiry = now + std::chrono::milliseconds(SESSION_TTL_MS);
+        shard.expiries.emplace_back(session->second.expiry, token);
+        username = session->second.username;
+        isMember = session->second.isMember;
+        return true;
+    }
+};
+
+
+// counters of the availability cache
+struct CacheStats {
+    std::atomic<long> hits{0}; // CH answered from allRoomData
+    std::atomic<long> misses{0}; // CH forwarded because the room layout is not in allRoomData
+    std::atomic<long> stale{0}; // backend replies that contradicted allRoomData
+    std::atomic<long> updates{0}; // updates pushed by backend servers and applied
+    std::atomic<long> lostUpdates{0}; // updates never received (gaps in a backend server's update versions)
+};
+
+
+/**
+ * Key of an IPv4 address and port, to look up which backend server sent a datagram
+ * @param addr address
+ * @return address in the upper, port in the lower bits
+ */
+static uint64_t addressKeyOf(const struct sockaddr_in& addr) {
+    return (uint64_t)addr.sin_addr.s_addr << 16 | addr.sin_port;
+}
+
+
+// what a replica backend server last reported about its replication lag
+struct ReplicaStatus {
+    std::atomic<long long> reportedAtMs{0}; // steady clock time of the last report, 0 if none yet
+    std::atomic<long> behind{0}; // updates of its primary not applied yet
+    std::atomic<bool> synced{false}; // holds the primary's whole room data
+};
+
+
+// data of the main server shared by all reactors; everything except allRoomData, the sessions, the member index,
+// the update versions and the cache counters is read-only once reactors run
+struct MainServerData {
+    SharedRoomData allRoomData;
+    bool cacheEnabled = false; // answer CH from allRoomData instead of forwarding it
+    size_t udpBatchSize = UDP_BATCH_SIZE; // max datagrams per recvmmsg/sendmmsg call
+    long udpFlushLatencyUs = UDP_FLUSH_LATENCY_US; // max time a request to a backend server waits for its batch
+    struct CacheStats cacheStats;
+    std::map<std::string, std::atomic<uint64_t>> updateVersions; // backend server name: last applied update version
+    ShardMap shards; // which backend server serves a room layout
     std::map<std::string, addrinfo *> backendServers;
-    std::map<std::string, std::string> memberData;
-    std::map<int, struct LoginStatus> loginStatuses;
+    std::unordered_map<uint64_t, std::string> backendNames; // IPv4 address and UDP port of a backend server: its name
+    std::map<std::string, std::vector<std::string>> replicas; // primary backend server name: names of its replicas
+    std::map<std::string, struct ReplicaStatus> replicaStatus; // replica name: its last lag report
+    // encrypted credentials of the members. A reload builds a new index and publishes it by swapping this pointer
+    // (std::atomic_load/atomic_store); a login keeps the index it loaded alive until it is done with it.
+    std::shared_ptr<const MemberIndex> members = std::make_shared<const MemberIndex>();
+    SessionTable sessions; // login sessions that reconnecting clients can resume
 
     std::string hostAddress;
-    std::string port_UDP, port_TCP; // port numbers
+    std::string port_UDP, port_TCP; // designated port numbers
+    std::string epoch; // start time, makes request and transaction IDs unique across restarts
+};
+
+
+/**
+ * One event loop thread of the main server. Every reactor has its own listening socket on the same TCP port
+ * (SO_REUSEPORT lets the kernel spread accepts across reactors), its own UDP socket towards the backend servers
+ * (so replies come back to the reactor that sent the request) and its own epoll instance.
+ */
+class Reactor {
+private:
+    MainServerData& server;
+    int reactorId;
+    std::unordered_map<int, struct ClientConnection> connections; // child sockfd: connection state
+    uint64_t nextConnectionId;
+
+    InflightTable inflight; // requests forwarded to backend servers, keyed by request ID
+    // (deadline, request ID) in the order the deadlines were set; since every request waits the same
+    // REQUEST_TIMEOUT_MS, this is also deadline order
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint64_t>> timeouts;
+    std::unordered_map<uint64_t, struct BatchRequest> batches; // batch ID: batch request with parts in flight
+    uint64_t nextBatchId = 1;
+
+    size_t nextReplica = 0; // round-robin position among the replicas of a backend server
+    std::unique_ptr<DatagramBatcher> batcher; // batched I/O of the UDP socket
+    std::map<std::string, struct InitTransfer> initTransfers; // backend server name: INIT progress (reactor 0 only)
+
+    std::string port_UDP; // port number of this reactor's UDP socket
     int sockfd_UDP, sockfd_TCP; // socket file descripters
+    int epollfd; // epoll instance multiplexing the listener, all child sockets and the UDP socket
 
 
-    // reused code from Beej's Guide 6.1
-    static void sigchld_handler(int s)
-    {
-        // waitpid() might overwrite errno, so we save and restore it:
-        int saved_errno = errno;
+    /**
+     * Register a file descripter to the epoll instance, or change the events it is watched for
+     * @param fd file descripter
+     * @param events epoll events (EPOLLIN/EPOLLOUT)
+     * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+     * @return whether successful or not
+     */
+    bool watch(int fd, uint32_t events, int op) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof ev);
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollfd, op, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            return false;
+        }
+        return true;
+    }
 
-        while(waitpid(-1, NULL, WNOHANG) > 0);
 
-        errno = saved_errno;
+    /**
+     * Close a client connection and drop its state
+     * @param childSockfd child socket file descripter
+     */
+    void closeClient(int childSockfd) {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, childSockfd, nullptr);
+        close(childSockfd);
+        connections.erase(childSockfd);
     }
 
 
     /**
-     * decrypt the string by offsetting each character and/or digit by -3.
-     * @param input encrypted string
-     * @return decrypted string
+     * Send as much of the connection's pending output as the socket accepts.
+     * Watches for EPOLLOUT while output is left over.
+     * @param childSockfd child socket file descripter
+     * @return false iff the connection has been closed
      */
-    static std::string decrypt_offset(const std::string& input) {
-        std::string decrypted;
-        for (char c : input) {
-            if (isdigit(c)) {
-                // For digits
-                int digit = c - '0';
-                digit = (digit - 3) % 10; // Apply cyclic offset for digits
-                decrypted += (digit + '0');
-            } else if (isalpha(c)) {
-                // For alphabets
-                char base = isupper(c) ? 'A' : 'a';
-                char decryptedChar = ((c - base - 3) % 26) + base; // Apply cyclic offset for alphabets
-                decrypted += decryptedChar;
-            } else {
-                // For other characters, append as it is
-                decrypted += c;
+    bool flushClient(int childSockfd) {
+        struct ClientConnection& conn = connections[childSockfd];
+        while (!conn.outBuf.empty()) {
+            ssize_t numbytes = send(childSockfd, conn.outBuf.data(), conn.outBuf.length(), MSG_NOSIGNAL);
+            if (numbytes == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return watch(childSockfd, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Send to client");
+                closeClient(childSockfd);
+                return false;
             }
+            conn.outBuf.erase(0, numbytes);
+        }
+        return watch(childSockfd, EPOLLIN, EPOLL_CTL_MOD);
+    }
+
+
+    /**
+     * Queue a message to a client and try to send it right away
+     * @param childSockfd child socket file descripter
+     * @param msg message to send
+     * @return false iff the connection has been closed
+     */
+    bool sendToClient(int childSockfd, const std::string& msg) {
+        struct ClientConnection& conn = connections[childSockfd];
+        bool wasIdle = conn.outBuf.empty();
+        conn.outBuf += msg;
+        if (!wasIdle) { // already waiting for EPOLLOUT
+            return true;
         }
-        return decrypted;
+        return flushClient(childSockfd);
     }
 
 
@@ -65,27 +492,25 @@ private:
      * Try to login with given encrypted username and password, and get login result
      * @param username encrypted username
      * @param password encrypted password
-     * @return login result: "LI_0"/"LI_1"/"LI_2"/"LI_3"/"LI_4"
+     * @return login result: "LI_0"/"LI_1"/"LI_2"/"LI_3"/"LI_4", followed by a session token on success
      */
-    void tryLogin(const int& childSockfd, const std::string& username, const std::string& password) {
-        std::regex pattern_username("[a-z]{5,50}");
-        std::regex pattern_password(".{5,50}");
+    void tryLogin(const int& childSockfd, std::string_view username, std::string_view password) {
         std::string loginRes, decrypted_username;
-        decrypted_username = decrypt_offset(username); // for printing on-screen messages
+        decrypted_username = decryptOffset(username); // for printing on-screen messages
 
         // empty password: guest login
         if (password.empty()) {
             std::cout << "The main server received the guest request for " << decrypted_username <<
-                " using TCP over port " << port_TCP << "." << std::endl;
-            loginStatuses[childSockfd].loggedIn = true;
-            loginStatuses[childSockfd].username = decrypted_username;
+                " using TCP over port " << server.port_TCP << "." << std::endl;
+            connections[childSockfd].loginStatus.loggedIn = true;
+            connections[childSockfd].loginStatus.isMember = false; // also after a member login on this connection
+            connections[childSockfd].loginStatus.username = decrypted_username;
             std::cout << "The main server accepts " << decrypted_username << " as a guest." << std::endl;
             loginRes = MSG_LOGIN_GUEST;
 
             // send guest response to client
-            if (send(childSockfd, loginRes.c_str(), loginRes.length(), 0) == -1) {
-                perror("Child socket: send");
-                exit(1);
+            if (!sendLoginResult(childSockfd, loginRes, server.sessions.create(decrypted_username, false))) {
+                return;
             }
             std::cout << "The main server sent the guest response to the client." << std::endl;
             return;
@@ -93,83 +518,774 @@ private:
 
         // member login
         std::cout << "The main server received the authentication for " << decrypted_username << " using TCP over port "
-            << port_TCP << "." << std::endl;
-        if (!std::regex_match(username, pattern_username)) { // check username validity
+            << server.port_TCP << "." << std::endl;
+        if (!isValidUsername(username)) { // check username validity
             loginRes = MSG_LOGIN_INVALID_USERNAME;
-        } else if (!std::regex_match(password, pattern_password)) { // check password validity
+        } else if (!isValidPassword(password)) { // check password validity
             loginRes = MSG_LOGIN_INVALID_PASSWORD;
-        } else if (memberData.find(username) == memberData.end()) { // username not found
-            loginRes = MSG_LOGIN_NOTFOUND;
-        } else { // compare with memberData
-            if (memberData[username] == password) {
+        } else { // look up the member and compare the password in one probe of the member index
+            enum MemberCheck check = std::atomic_load(&server.members)->check(username, password);
+            if (check == MEMBER_NOT_FOUND) { // username not found
+                loginRes = MSG_LOGIN_NOTFOUND;
+            } else if (check == MEMBER_MATCH) {
                 // successful login
-                loginStatuses[childSockfd].loggedIn = true;
-                loginStatuses[childSockfd].isMember = true;
-                loginStatuses[childSockfd].username = decrypted_username;
+                connections[childSockfd].loginStatus.loggedIn = true;
+                connections[childSockfd].loginStatus.isMember = true;
+                connections[childSockfd].loginStatus.username = decrypted_username;
                 loginRes = MSG_LOGIN_MEMBER;
             } else { // incorrect password
                 loginRes = MSG_LOGIN_FAIL;
             }
-        }
-        // send authentication result to client.
-        if (send(childSockfd, loginRes.c_str(), loginRes.length(), 0) == -1) {
-            perror("Child socket: send");
+        }
+        if (loginRes != MSG_LOGIN_MEMBER) { // a failed login ends an earlier one of the connection
+            connections[childSockfd].loginStatus = {"", false, false};
+        }
+        // send authentication result to client.
+        std::string token;
+        if (loginRes == MSG_LOGIN_MEMBER) {
+            token = server.sessions.create(decrypted_username, true);
+        }
+        if (!sendLoginResult(childSockfd, loginRes, token)) {
+            return;
+        }
+        std::cout << "The main server sent the authentication result to the client." << std::endl;
+    }
+
+
+    /**
+     * Log a client in by the token of a session it started before, skipping the username and password checks
+     * @param childSockfd child socket file descripter
+     * @param token session token
+     */
+    void tryResume(int childSockfd, const std::string& token) {
+        std::string username;
+        bool isMember = false;
+        if (!server.sessions.resume(token, username, isMember)) {
+            std::cout << "The main server received an unknown or expired session using TCP over port "
+                << server.port_TCP << "." << std::endl;
+            sendLoginResult(childSockfd, MSG_LOGIN_EXPIRED);
+            return;
+        }
+        connections[childSockfd].loginStatus = {username, true, isMember};
+        std::cout << "The main server resumed the session of " << username << " as a " << (isMember ? "member" : "guest")
+            << " using TCP over port " << server.port_TCP << "." << std::endl;
+        sendLoginResult(childSockfd, isMember ? MSG_LOGIN_MEMBER : MSG_LOGIN_GUEST, token);
+    }
+
+
+    /**
+     * Pick the backend server to send an availability check to: the replicas of the primary take turns, skipping
+     * the ones that are not synced, more than REPLICA_MAX_LAG updates behind or silent for 3 report intervals
+     * @param primary name of the primary backend server that serves the room layout
+     * @return name of a replica, or the primary if none is fit
+     */
+    const std::string& readTarget(const std::string& primary) {
+        auto replicas = server.replicas.find(primary);
+        if (replicas == server.replicas.end()) {
+            return primary;
+        }
+        long long nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        const std::vector<std::string>& names = replicas->second;
+        for (size_t i = 0; i < names.size(); i++) {
+            const std::string& name = names[(nextReplica + i) % names.size()];
+            const struct ReplicaStatus& status = server.replicaStatus.at(name);
+            if (status.synced && status.behind <= REPLICA_MAX_LAG && status.reportedAtMs > 0 &&
+                nowMs - status.reportedAtMs <= 3 * REPLICA_REPORT_MS) {
+                nextReplica += i + 1;
+                return name;
+            }
+        }
+        return primary;
+    }
+
+
+    /**
+     * Record a replica backend server's lag report: "LAG\n(updates behind)\n(delay of the last update in us)\n(synced)"
+     * @param serverName name of the replica
+     * @param iss the report, after its op code line
+     */
+    void applyLagReport(const std::string& serverName, std::istringstream& iss) {
+        auto status = server.replicaStatus.find(serverName);
+        if (status == server.replicaStatus.end()) {
+            return;
+        }
+        std::string behind, delayUs, synced;
+        getline(iss, behind);
+        getline(iss, delayUs);
+        getline(iss, synced);
+        long newBehind = atol(behind.c_str());
+        bool newSynced = synced == "1";
+        if (newBehind != status->second.behind || newSynced != status->second.synced) {
+            std::cout << "Replica " << serverName << (newSynced ? " is " + behind + " updates behind its primary"
+                " (last update took " + delayUs + " us)." : " is syncing with its primary.") << std::endl;
+        }
+        status->second.behind = newBehind;
+        status->second.synced = newSynced;
+        status->second.reportedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+    /**
+     * Queue the datagram of an in-flight request to its backend server; sent by flushBackendRequests()
+     * @param request the request
+     */
+    void sendToBackend(const struct InflightRequest& request) {
+        const struct addrinfo *backendInfo = server.backendServers.at(request.backendServerName);
+        if (!batcher->queue(request.msg, backendInfo->ai_addr, backendInfo->ai_addrlen)) {
+            perror("Server M: sendmmsg");
+            exit(1);
+        }
+    }
+
+
+    /**
+     * Send the queued datagrams to backend servers, once the oldest one has waited for the flush latency
+     * @param force send them now
+     */
+    void flushBackendRequests(bool force) {
+        if (batcher->numQueued() == 0 || (!force && std::chrono::steady_clock::now() <
+            batcher->oldestQueued() + std::chrono::microseconds(server.udpFlushLatencyUs))) {
+            return;
+        }
+        if (!batcher->flush()) {
+            perror("Server M: sendmmsg");
+            exit(1);
+        }
+    }
+
+
+    /**
+     * Retransmit the in-flight requests whose deadline has passed, and give up on the ones that have been
+     * retransmitted MAX_RETRANSMITS times by replying MSG_REQUEST_TIMEOUT to the client. A commit of a group
+     * reservation is retransmitted until it is answered or the backend server's hold has surely expired.
+     */
+    void expireRequests() {
+        auto now = std::chrono::steady_clock::now();
+        while (!timeouts.empty() && timeouts.front().first <= now) {
+            uint64_t requestId = timeouts.front().second;
+            timeouts.pop_front();
+            struct InflightRequest *request = inflight.find(requestId);
+            if (request == nullptr || request->deadline > now) { // answered, or retransmitted with a later deadline
+                continue;
+            }
+            if (request->retransmits < MAX_RETRANSMITS || now < request->retransmitUntil) {
+                request->retransmits++;
+                request->deadline = now + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+                timeouts.emplace_back(request->deadline, requestId);
+                sendToBackend(*request);
+#ifdef DEBUG
+                std::cout << "Retransmitted request " << requestId << " to Server " << request->backendServerName << std::endl;
+#endif
+                continue;
+            }
+
+            int childSockfd = request->childSockfd;
+            uint64_t connectionId = request->connectionId;
+            std::string seq = request->seq;
+            std::string backendServerName = request->backendServerName;
+            uint64_t batchId = request->batchId;
+            std::vector<size_t> batchIndexes = std::move(request->batchIndexes);
+            inflight.erase(requestId);
+            std::cout << "The main server did not receive the response from Server " << backendServerName << "." << std::endl;
+            if (batchId != 0) {
+                completeBatchPart(batchId, batchIndexes, std::vector<std::string>(batchIndexes.size(), MSG_REQUEST_TIMEOUT));
+                continue;
+            }
+            auto conn = connections.find(childSockfd);
+            if (conn != connections.end() && conn->second.connectionId == connectionId) {
+                replyToClient(childSockfd, MSG_REQUEST_TIMEOUT, seq);
+            }
+        }
+    }
+
+
+    /**
+     * @return milliseconds until the earliest in-flight request deadline or flush of queued backend requests,
+     * or -1 if there is neither
+     */
+    int nextTimeoutMs() const {
+        std::chrono::steady_clock::time_point next;
+        if (batcher->numQueued() > 0) { // flush the queued backend requests
+            next = batcher->oldestQueued() + std::chrono::microseconds(server.udpFlushLatencyUs);
+            if (!timeouts.empty()) {
+                next = std::min(next, timeouts.front().first);
+            }
+        }
+        else if (!timeouts.empty()) {
+            next = timeouts.front().first;
+        }
+        else {
+            return -1;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+        return std::max<long long>(0, wait + 1);
+    }
+
+
+    /**
+     * Apply one chunk of a backend server's INIT transfer and acknowledge it.
+     * Chunk: "INIT\n(transferid)\n(seq)\n(total)\n(room_data_entries)"; acknowledgement: "INIT_ACK\n(transferid)\n(seq)".
+     * A retransmitted chunk is acknowledged again but not applied again, so it cannot undo later reservations.
+     * Chunks of senders not in the backends configuration file, or of more than INIT_MAX_CHUNKS chunks, are dropped.
+     * @param serverName name of the backend server, empty if the sender is not one
+     * @param msg the datagram
+     * @param senderAddr address of the backend server
+     */
+    void handleInitChunk(const std::string& serverName, std::string_view msg, const struct sockaddr_in& senderAddr) {
+        std::string_view header[4]; // op, transfer ID, seq, total
+        for (std::string_view& line : header) {
+            size_t end = msg.find('\n');
+            if (end == std::string_view::npos) {
+                return;
+            }
+            line = msg.substr(0, end);
+            msg.remove_prefix(end + 1);
+        }
+        std::string transferId(header[1]);
+        size_t seq = strtoul(std::string(header[2]).c_str(), nullptr, 10);
+        size_t total = strtoul(std::string(header[3]).c_str(), nullptr, 10);
+        if (serverName.empty() || total == 0 || total > INIT_MAX_CHUNKS) { // not from a backend server, or bogus
+            return;
+        }
+
+        struct InitTransfer& transfer = initTransfers[serverName];
+        if (transfer.transferId != transferId) { // a new transfer
+            transfer.transferId = transferId;
+            transfer.received.assign(total, false);
+            transfer.numReceived = transfer.numRooms = 0;
+            transfer.start = std::chrono::steady_clock::now();
+            auto versions = server.updateVersions.find(serverName);
+            if (versions != server.updateVersions.end()) { // a restarted backend server numbers updates from 1 again
+                versions->second = 0;
+            }
+        }
+        if (seq < transfer.received.size() && !transfer.received[seq]) {
+            std::string_view roomcode;
+            int numAvailable;
+            while (!msg.empty()) {
+                size_t end = msg.find('\n');
+                std::string_view line = msg.substr(0, end);
+                msg.remove_prefix(end == std::string_view::npos ? msg.length() : end + 1);
+                if (scanRoomEntry(line, roomcode, numAvailable)) {
+                    server.allRoomData.set(std::string(roomcode), numAvailable);
+                    transfer.numRooms++;
+                }
+            }
+            transfer.received[seq] = true;
+            transfer.numReceived++;
+
+            if (transfer.numReceived == transfer.received.size()) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - transfer.start).count();
+#ifdef DEBUG
+                std::cout << "My data after INIT: \n" << server.allRoomData.toStr() << std::endl;
+#endif
+                std::cout << "The main server has received the room status from Server " << serverName <<
+                    " using UDP over port " << port_UDP << "." << std::endl;
+                std::cout << "(" << transfer.numRooms << " rooms in " << total << " chunks, " << seconds * 1000 << " ms, "
+                    << transfer.numRooms / std::max(seconds, 1e-6) << " rooms/s)" << std::endl;
+            }
+        }
+
+        std::string ack = std::string(MSG_INIT_ACK) + "\n" + transferId + "\n" + std::to_string(seq);
+        batcher->queue(ack, (const struct sockaddr *)&senderAddr, sizeof senderAddr);
+    }
+
+
+    /**
+     * Handle a CHB/REB request: split its roomcodes by backend server (the shard serving the roomcode), send one
+     * request per backend server, and reply once all of them are answered. Roomcodes of unknown backend servers
+     * (and, with the cache enabled, checks of cached room layouts) are answered right away.
+     * @param childSockfd client socket
+     * @param op MSG_CHECK_BATCH or MSG_RESERVE_BATCH
+     * @param seq the client's sequence number of the request
+     * @param data comma-separated roomcodes
+     */
+    void handleBatchRequest(int childSockfd, const std::string& op, const std::string& seq, std::string_view data) {
+        struct LoginStatus& loginStatus = connections[childSockfd].loginStatus;
+        bool check = op == MSG_CHECK_BATCH;
+        std::vector<std::string> roomcodes;
+        while (!data.empty()) {
+            size_t end = std::min(data.find(','), data.length());
+            if (end > 0) {
+                roomcodes.emplace_back(data.substr(0, end));
+            }
+            data.remove_prefix(std::min(end + 1, data.length()));
+        }
+        std::cout << "The main server has received the batch " << (check ? "availability" : "reservation")
+            << " request on " << roomcodes.size() << " rooms from " << loginStatus.username << " using TCP over port "
+            << server.port_TCP << "." << std::endl;
+
+        struct BatchRequest batch;
+        batch.childSockfd = childSockfd;
+        batch.connectionId = connections[childSockfd].connectionId;
+        batch.op = op;
+        batch.seq = seq;
+        batch.roomcodes = roomcodes;
+        batch.results.assign(roomcodes.size(), "");
+        std::map<std::string, std::vector<size_t>> parts; // backend server name: positions of its roomcodes
+
+        if (roomcodes.size() > MAX_BATCH_ROOMS) { // answered with an empty result list
+            batch.results.clear();
+        }
+        else if (!check && !loginStatus.isMember) {
+            std::cout << loginStatus.username << " cannot make a reservation." << std::endl;
+            batch.results.assign(roomcodes.size(), MSG_RESERVE_DENIED);
+        }
+        else {
+            for (size_t i = 0; i < roomcodes.size(); i++) {
+                const std::string& backendServerName = server.shards.route(roomcodes[i]);
+                int numAvailable;
+                if (server.backendServers.find(backendServerName) == server.backendServers.end()) {
+                    batch.results[i] = check ? MSG_CHECK_NOTFOUND : MSG_RESERVE_NOTFOUND;
+                }
+                else if (check && server.cacheEnabled && server.allRoomData.get(roomcodes[i], numAvailable)) {
+                    server.cacheStats.hits++;
+                    reportCacheStats();
+                    batch.results[i] = numAvailable > 0 ? MSG_CHECK_AVAILABLE : MSG_CHECK_UNAVAILABLE;
+                }
+                else {
+                    if (check && server.cacheEnabled) {
+                        server.cacheStats.misses++;
+                        reportCacheStats();
+                    }
+                    parts[check ? readTarget(backendServerName) : backendServerName].push_back(i);
+                }
+            }
+        }
+
+        if (parts.empty()) {
+            sendBatchResult(batch);
+            return;
+        }
+        // a group reservation is all-or-nothing: each backend server first only holds its rooms (prepare)
+        uint64_t batchId = nextBatchId++;
+        batch.parts = parts;
+        batch.numPending = parts.size();
+        batch.txid = server.epoch + "-" + std::to_string(reactorId) + "-" + std::to_string(batchId);
+        batch.phase = 1;
+        for (const auto& part : parts) {
+            std::string body = check ? "" : "\n" + batch.txid;
+            for (size_t i : part.second) {
+                body += "\n" + roomcodes[i];
+            }
+            sendBatchPart(batchId, batch, part.first, part.second, check ? MSG_CHECK_BATCH : MSG_PREPARE, body);
+            std::cout << "The main server sent a request to Server " << part.first << "." << std::endl;
+        }
+        batches[batchId] = std::move(batch);
+    }
+
+
+    /**
+     * Send one backend server's part of a batch request, kept in flight like a single request
+     * @param batchId batch ID
+     * @param batch the batch request
+     * @param backendServerName name of the backend server
+     * @param batchIndexes positions of the part's roomcodes in the batch
+     * @param op op code of the part
+     * @param body lines of the part after the request ID, each starting with "\n"
+     */
+    void sendBatchPart(uint64_t batchId, const struct BatchRequest& batch, const std::string& backendServerName,
+                       const std::vector<size_t>& batchIndexes, const std::string& op, const std::string& body) {
+        struct InflightRequest request;
+        request.childSockfd = batch.childSockfd;
+        request.connectionId = batch.connectionId;
+        request.seq = batch.seq;
+        request.backendServerName = backendServerName;
+        request.batchId = batchId;
+        request.batchIndexes = batchIndexes;
+        request.retransmits = 0;
+        request.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+        if (op == MSG_COMMIT) { // the hold was taken before now, so its lease ends before this
+            request.retransmitUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(HOLD_LEASE_MS);
+        }
+        uint64_t requestId = inflight.insert(request);
+
+        struct InflightRequest *stored = inflight.find(requestId);
+        stored->msg = op + "\n" + wireIdOf(requestId) + body;
+        timeouts.emplace_back(stored->deadline, requestId);
+        sendToBackend(*stored);
+    }
+
+
+    /**
+     * Second phase of a group reservation, once every backend server has answered the prepare: commit if every
+     * room is held, otherwise abort, so that no room of the group stays reserved. Aborted holds are not waited for;
+     * a backend server that misses the abort releases the rooms when their lease expires.
+     * @param batchId batch ID
+     * @param batch the batch request
+     * @return whether the batch is finished (aborted), or waits for the commits
+     */
+    bool finishPrepare(uint64_t batchId, struct BatchRequest& batch) {
+        bool allHeld = std::all_of(batch.results.begin(), batch.results.end(),
+                                   [](const std::string& result) { return result == MSG_RESERVE_SUCCEED; });
+        batch.phase = 2;
+        batch.numPending = batch.parts.size();
+        for (const auto& part : batch.parts) {
+            sendBatchPart(batchId, batch, part.first, part.second, allHeld ? MSG_COMMIT : MSG_ABORT, "\n" + batch.txid);
+            std::cout << "The main server sent " << (allHeld ? "a commit" : "an abort") << " request to Server "
+                << part.first << "." << std::endl;
+        }
+        if (allHeld) {
+            return false;
+        }
+        for (std::string& result : batch.results) {
+            if (result == MSG_RESERVE_SUCCEED) { // held, but given back
+                result = MSG_RESERVE_ABORTED;
+            }
+        }
+        sendBatchResult(batch);
+        return true;
+    }
+
+
+    /**
+     * Apply a backend server's reply to its part of a batch request. A CHB_R/PRE_R reply has the backend server's
+     * update version, then one "(result op code),(num_available)" line per roomcode of the part, in order; the
+     * available numbers refresh the cache of all room data unless it has later ones. A COM_x reply settles the part's rooms of a committed group reservation.
+     * @param serverName name of the backend server
+     * @param op op code of the reply
+     * @param batchId batch ID
+     * @param batchIndexes positions of the part's roomcodes in the batch
+     * @param iss the reply, after its request ID line
+     */
+    void handleBatchReply(const std::string& serverName, const std::string& op, uint64_t batchId,
+                          const std::vector<size_t>& batchIndexes, std::istringstream& iss) {
+        std::cout << "The main server received the response from Server " << serverName << " using UDP over port "
+            << port_UDP << "." << std::endl;
+        if (op == MSG_COMMIT_OK || op == MSG_COMMIT_EXPIRED) {
+            completeBatchPart(batchId, batchIndexes, std::vector<std::string>(batchIndexes.size(),
+                op == MSG_COMMIT_OK ? MSG_RESERVE_SUCCEED : MSG_RESERVE_UNCOMMITTED));
+            return;
+        }
+        if (op == MSG_ABORT_OK) { // the batch has been answered already
+            return;
+        }
+        std::vector<std::string> results;
+        std::string line;
+        getline(iss, line);
+        uint64_t version = strtoull(line.c_str(), nullptr, 10);
+        while (results.size() < batchIndexes.size() && getline(iss, line)) {
+            size_t comma = line.find(',');
+            int numAvailable = comma == std::string::npos ? -1 : atoi(line.c_str() + comma + 1);
+            auto batch = batches.find(batchId);
+            if (numAvailable >= 0 && batch != batches.end()) {
+                server.allRoomData.set(batch->second.roomcodes[batchIndexes[results.size()]], numAvailable, version);
+            }
+            results.push_back(line.substr(0, comma));
+        }
+        results.resize(batchIndexes.size(), MSG_REQUEST_TIMEOUT);
+        completeBatchPart(batchId, batchIndexes, results);
+    }
+
+
+    /**
+     * Store the results of one part of a batch request, and reply to the client once every part is answered
+     * @param batchId batch ID
+     * @param batchIndexes positions of the part's roomcodes in the batch
+     * @param results result op code per position
+     */
+    void completeBatchPart(uint64_t batchId, const std::vector<size_t>& batchIndexes, const std::vector<std::string>& results) {
+        auto it = batches.find(batchId);
+        if (it == batches.end()) {
+            return;
+        }
+        struct BatchRequest& batch = it->second;
+        for (size_t i = 0; i < batchIndexes.size(); i++) {
+            batch.results[batchIndexes[i]] = results[i];
+        }
+        if (--batch.numPending == 0) {
+            if (batch.op == MSG_RESERVE_BATCH && batch.phase == 1) {
+                if (!finishPrepare(batchId, batch)) { // waits for the commits
+                    return;
+                }
+            } else {
+                if (batch.op == MSG_RESERVE_BATCH) {
+                    reportUncommitted(batch);
+                }
+                sendBatchResult(batch);
+            }
+            batches.erase(it);
+        }
+    }
+
+
+    /**
+     * After the commits of a group reservation: the rooms of parts whose commit failed (COM_0, or no answer until
+     * the hold expired) are not reserved, although the other parts' are. They are answered RE_5, so the client
+     * sees which rooms of the group it got; if no part was committed, nothing is reserved and they are answered TO.
+     * @param batch the batch request
+     */
+    void reportUncommitted(struct BatchRequest& batch) {
+        bool anyCommitted = std::count(batch.results.begin(), batch.results.end(), MSG_RESERVE_SUCCEED) > 0;
+        std::vector<std::string> uncommitted;
+        for (size_t i = 0; i < batch.results.size(); i++) {
+            if (batch.results[i] == MSG_RESERVE_UNCOMMITTED || batch.results[i] == MSG_REQUEST_TIMEOUT) {
+                batch.results[i] = anyCommitted ? MSG_RESERVE_UNCOMMITTED : MSG_REQUEST_TIMEOUT;
+                uncommitted.push_back(batch.roomcodes[i]);
+            }
+        }
+        if (anyCommitted && !uncommitted.empty()) {
+            std::cout << "The group reservation was only partly committed; not reserved:";
+            for (const std::string& roomcode : uncommitted) {
+                std::cout << " " << roomcode;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+
+    /**
+     * Reply the merged results of a batch request to its client, unless it has disconnected meanwhile
+     * @param batch the batch request
+     */
+    void sendBatchResult(const struct BatchRequest& batch) {
+        auto conn = connections.find(batch.childSockfd);
+        if (conn == connections.end() || conn->second.connectionId != batch.connectionId) {
+            return;
+        }
+        std::string results;
+        for (const std::string& result : batch.results) {
+            results += (results.empty() ? "" : ",") + result;
+        }
+        bool check = batch.op == MSG_CHECK_BATCH;
+        if (replyToClient(batch.childSockfd, check ? MSG_CHECK_BATCH_RESULT : MSG_RESERVE_BATCH_RESULT, batch.seq, results)) {
+            std::cout << "The main server sent the " << (check ? "availability information" : "reservation result")
+                << " of " << batch.results.size() << " rooms to the client." << std::endl;
+        }
+    }
+
+
+    /**
+     * Answer an availability check from the cache of all room data
+     * @param childSockfd client socket
+     * @param roomcode room layout code
+     * @param seq the client's sequence number of the request
+     * @return whether answered; false if the room layout is not cached, so the request goes to its backend server
+     */
+    bool answerFromCache(int childSockfd, const std::string& roomcode, const std::string& seq) {
+        int numAvailable;
+        if (!server.allRoomData.get(roomcode, numAvailable)) {
+            server.cacheStats.misses++;
+            reportCacheStats();
+            return false;
+        }
+        server.cacheStats.hits++;
+        reportCacheStats();
+        std::cout << "The main server answered the availability request from its cache." << std::endl;
+        if (replyToClient(childSockfd, numAvailable > 0 ? MSG_CHECK_AVAILABLE : MSG_CHECK_UNAVAILABLE, seq)) {
+            std::cout << "The main server sent the availability information to the client." << std::endl;
+        }
+        return true;
+    }
+
+
+    /**
+     * Print the cache counters every CACHE_REPORT_INTERVAL cached lookups
+     */
+    void reportCacheStats() {
+        const struct CacheStats& stats = server.cacheStats;
+        long hits = stats.hits, misses = stats.misses;
+        if ((hits + misses) % CACHE_REPORT_INTERVAL != 0) {
+            return;
+        }
+        std::cout << "(cache: " << hits << " hits, " << misses << " misses, hit rate " << 100.0 * hits / (hits + misses)
+            << "%, " << stats.stale << " stale, " << stats.updates << " updates, " << stats.lostUpdates << " lost updates)"
+            << std::endl;
+    }
+
+
+    /**
+     * Count a backend reply that contradicts the cache of all room data, before the reply updates it
+     * @param op op code of the reply
+     * @param roomcode room layout code of the request
+     * @param reply the whole reply
+     */
+    void checkCache(const std::string& op, const std::string& roomcode, const std::string& reply) {
+        int cached;
+        bool known = server.allRoomData.get(roomcode, cached);
+        bool stale = false;
+        if (op == MSG_CHECK_NOTFOUND || op == MSG_RESERVE_NOTFOUND) {
+            stale = known;
+        }
+        else if (op == MSG_CHECK_AVAILABLE || op == MSG_CHECK_UNAVAILABLE) {
+            stale = !known || (cached > 0) != (op == MSG_CHECK_AVAILABLE);
+        }
+        else if (op == MSG_RESERVE_FAIL) {
+            stale = !known || cached > 0;
+        }
+        else if (op == MSG_RESERVE_SUCCEED) {
+            std::string entryRoomcode;
+            int numAvailable;
+            getDataFromLine(reply.substr(reply.rfind('\n') + 1), entryRoomcode, numAvailable);
+            stale = !known || cached != numAvailable + 1;
+        }
+        if (stale) {
+            server.cacheStats.stale++;
+        }
+    }
+
+
+    /**
+     * Apply a room status update pushed by a backend server: "UPD\n(version)\n(roomcode),(num_available)".
+     * An update older than the cached count of its room layout is dropped; a gap in the backend server's versions
+     * counts as lost updates until the missing ones arrive.
+     * @param serverName name of the backend server
+     * @param iss the message, after its op code line
+     */
+    void applyUpdate(const std::string& serverName, std::istringstream& iss) {
+        auto versions = server.updateVersions.find(serverName);
+        if (versions == server.updateVersions.end()) {
+            return;
+        }
+        std::string line, roomcode;
+        int numAvailable;
+        getline(iss, line);
+        uint64_t version = strtoull(line.c_str(), nullptr, 10);
+        getline(iss, line);
+        getDataFromLine(line, roomcode, numAvailable);
+        if (roomcode.empty()) {
+            return;
+        }
+
+        uint64_t last = versions->second;
+        while (version > last && !versions->second.compare_exchange_weak(last, version)) {
+        }
+        if (version > last) {
+            server.cacheStats.lostUpdates += version - last - 1;
+        } else if (version < last) { // reordered: it fills a gap counted before
+            server.cacheStats.lostUpdates--;
+        }
+        if (server.allRoomData.set(roomcode, numAvailable, version)) {
+            server.cacheStats.updates++;
+        }
+#ifdef DEBUG
+        std::cout << "Applied update " << version << " from Server " << serverName << ": " << line << std::endl;
+#endif
+    }
+
+
+    /**
+     * Receive a batch of datagrams from backend servers over the UDP port, and react accordingly.
+     * @return whether the batch was full, so more datagrams may be pending
+     */
+    bool handleBackendServer() {
+        int numReceived = batcher->receive(MSG_DONTWAIT);
+        if (numReceived == -1) {
+            if (errno == EINTR) {
+                return false;
+            }
+            perror("recvmmsg");
             exit(1);
         }
-        std::cout << "The main server sent the authentication result to the client." << std::endl;
+        for (int i = 0; i < numReceived; i++) {
+            std::string_view datagram = batcher->datagram(i);
+            handleBackendDatagram(datagram.data(), datagram.length(), (const struct sockaddr_in&)batcher->sender(i));
+        }
+        if (batcher->reportDue()) {
+            std::cout << "The main server UDP batching: " << batcher->statsStr() << std::endl;
+        }
+        return numReceived == (int)batcher->getBatchSize();
     }
 
 
     /**
-     * recvfrom backend servers over the UDP port, and react accordingly.
+     * Request ID as sent to backend servers: "(request ID)-(epoch)". The in-flight table numbers requests the same
+     * way on every start, so the epoch keeps a backend server that outlives the main server from answering a new
+     * request with its remembered reply to an old one of the same number.
+     * @param requestId request ID in the in-flight table
+     * @return the request ID line
      */
-    void handleBackendServer() {
-        struct sockaddr_in backend_server_address; // store sender's address
-        socklen_t addr_len = sizeof(backend_server_address);
-
-        int numbytes; // number of bytes of the received datagram
-        char buf[MAXBUFLEN];
-        std::string op; // store operation code
+    std::string wireIdOf(uint64_t requestId) const {
+        return std::to_string(requestId) + "-" + server.epoch;
+    }
 
-        numbytes = recvfrom(sockfd_UDP, buf, MAXBUFLEN-1 , 0, (struct sockaddr *)&backend_server_address, &addr_len);
-        std::string serverName = portToServerName(LOCAL_HOST, std::to_string(ntohs(backend_server_address.sin_port)));
 
-        if (numbytes == -1) {
-            perror("recvfrom");
-            exit(1);
+    /**
+     * Parse the request ID line of a backend server's reply
+     * @param line "(request ID)-(epoch)"
+     * @param requestId to store the request ID in the in-flight table
+     * @return whether the line is a request ID of this run of the main server
+     */
+    bool parseWireId(const std::string& line, uint64_t& requestId) const {
+        size_t dash = line.find('-');
+        if (dash == std::string::npos || line.compare(dash + 1, std::string::npos, server.epoch) != 0) {
+            return false;
         }
-        buf[numbytes] = '\0';
-        std::istringstream iss(buf);
-#ifdef DEBUG
-        std::cout << "Received message from Server " << serverName << ": " << iss.str() << std::endl;
-#endif
-        getline(iss, op); // extract operation code from the 1st line
+        requestId = strtoull(line.c_str(), nullptr, 10);
+        return true;
+    }
 
 
-        if (op == MSG_INIT) { // do data initialization
-            std::string line;
-            while (getline(iss, line)) {
-                addLineToMap(line, allRoomData);
-            }
+    /**
+     * React to one datagram from a backend server
+     * @param buf the datagram, '\0'-terminated
+     * @param numbytes length of the datagram
+     * @param backend_server_address sender's address
+     */
+    void handleBackendDatagram(const char *buf, int numbytes, const struct sockaddr_in& backend_server_address) {
+        std::string op; // store operation code
+
+        auto sender = server.backendNames.find(addressKeyOf(backend_server_address));
+        std::string serverName = sender == server.backendNames.end() ? "" : sender->second;
 #ifdef DEBUG
-            std::cout << "My data after INIT: \n" << dataToStr(allRoomData) << std::endl;
+        std::cout << "Received message from Server " << serverName << ": " << buf << std::endl;
 #endif
-            std::cout << "The main server has received the room status from Server " << serverName <<
-                " using UDP over port " << port_UDP << "." << std::endl;
+        if (strncmp(buf, MSG_INIT "\n", strlen(MSG_INIT "\n")) == 0) { // do data initialization
+            handleInitChunk(serverName, std::string_view(buf, numbytes), backend_server_address);
+            return;
         }
-        else { // extract child sockfd info
+        std::istringstream iss(buf);
+        getline(iss, op); // extract operation code from the 1st line
+
+        if (op == MSG_UPDATE) {
+            applyUpdate(serverName, iss);
+            return;
+        }
+        if (op == MSG_REPLICA_LAG) {
+            applyLagReport(serverName, iss);
+            return;
+        }
+
+        { // extract request ID and look up the originating client
             std::string line; // to temporarily store a line of string read from iss
             getline(iss, line);
-            int childSockfd = std::stoi(line);
+            uint64_t requestId = 0;
+            struct InflightRequest *request = parseWireId(line, requestId) ? inflight.find(requestId) : nullptr;
+            if (request == nullptr) { // a duplicate reply to a retransmitted request, a request given up on, or a
+                                      // request of a previous run of the main server
+#ifdef DEBUG
+                std::cout << "Dropped reply to unknown request " << line << std::endl;
+#endif
+                return;
+            }
+            int childSockfd = request->childSockfd;
+            uint64_t connectionId = request->connectionId;
+            std::string seq = request->seq;
+            std::string roomcode = request->roomcode;
+            if (request->batchId != 0) {
+                uint64_t batchId = request->batchId;
+                std::vector<size_t> batchIndexes = std::move(request->batchIndexes);
+                inflight.erase(requestId);
+                handleBatchReply(serverName, op, batchId, batchIndexes, iss);
+                return;
+            }
+            inflight.erase(requestId);
+            if (server.cacheEnabled) {
+                checkCache(op, roomcode, iss.str());
+            }
+
             if (op == MSG_RESERVE_SUCCEED) {
                 std::cout << "The main server received the response and the updated room status from Server "
                 << serverName << " using UDP over port " << port_UDP << "." << std::endl;
-                // update the room status
+                // update the room status: the backend server's update version, then "(roomcode),(num_available)"
+                getline(iss, line);
+                uint64_t version = strtoull(line.c_str(), nullptr, 10);
                 getline(iss, line);
-                std::string roomcode;
                 int newNumAvailable;
                 getDataFromLine(line, roomcode, newNumAvailable);
-                allRoomData[roomcode] = newNumAvailable;
+                server.allRoomData.set(roomcode, newNumAvailable, version);
                 std::cout << "The room status of Room " << roomcode << " has been updated." << std::endl;
             }
             else {
@@ -177,10 +1293,13 @@ private:
                         " using UDP over port " << port_UDP << "." << std::endl;
             }
 
-            // forward the same op code to the client
-            if (send(childSockfd, op.c_str(), op.length(), 0) == -1) {
-                perror(("Send to client: " + op).c_str());
-                exit(1);
+            // forward the same op code to the client, unless it has disconnected meanwhile
+            auto conn = connections.find(childSockfd);
+            if (conn == connections.end() || conn->second.connectionId != connectionId) {
+                return;
+            }
+            if (!replyToClient(childSockfd, op, seq)) {
+                return;
             }
 
             // print on-screen message
@@ -197,121 +1316,272 @@ private:
 
 
     /**
-     * recv from a client over the TCP port, and react accordingly.
+     * Send the reply to one request of a client, tagged with the request's sequence number
      * @param childSockfd child socket file descripter
-     * @return false iff connection is closed
+     * @param op reply op code
+     * @param seq sequence number of the request
+     * @return false iff the connection has been closed
      */
-    bool handleClient(int childSockfd) {
-        int numbytes; // number of bytes of the received message
-        char buf[MAXBUFLEN];
-        std::string op; // store operation code
+    bool replyToClient(int childSockfd, const std::string& op, const std::string& seq, const std::string& data = "") {
+        if (connections[childSockfd].protocol == WIRE_BINARY) {
+            std::string frame;
+            encodeFrame(frame, op, strtoull(seq.c_str(), nullptr, 10), data);
+            return sendToClient(childSockfd, frame);
+        }
+        if (numFieldsOf(op) == 2) { // batch results
+            return sendToClient(childSockfd, op + "\n" + seq + "\n" + data + "\n");
+        }
+        return sendToClient(childSockfd, op + "\n" + seq + "\n");
+    }
 
-        numbytes = recv(childSockfd, buf, MAXBUFLEN-1, 0);
-        if (numbytes == -1) {
-            perror("recv");
-            return false;
+
+    /**
+     * Send a login result to a client, followed by its session token if there is one
+     * @param childSockfd child socket file descripter
+     * @param loginRes login result op code
+     * @param token session token, empty if none
+     * @return false iff the connection has been closed
+     */
+    bool sendLoginResult(int childSockfd, const std::string& loginRes, const std::string& token = "") {
+        if (connections[childSockfd].protocol == WIRE_BINARY) {
+            std::string frames;
+            encodeFrame(frames, loginRes, 0, "");
+            if (!token.empty()) {
+                encodeFrame(frames, MSG_SESSION_TOKEN, 0, token);
+            }
+            return sendToClient(childSockfd, frames);
         }
-        if (numbytes == 0) {
-            return false;
+        std::string msg = loginRes + "\n";
+        if (!token.empty()) {
+            msg += MSG_SESSION_TOKEN "\n" + token + "\n";
         }
-        buf[numbytes] = '\0';
-        std::istringstream iss(buf);
+        return sendToClient(childSockfd, msg);
+    }
+
+
+    /**
+     * React to one complete message from a client, received in either wire protocol
+     * @param childSockfd child socket file descripter
+     * @param opView op code
+     * @param seqView sequence number of a CH/RE request
+     * @param data login info of a LI request, session token of a LR request, or roomcode of a CH/RE request
+     */
+    void handleClientMessage(int childSockfd, std::string_view opView, std::string_view seqView, std::string_view data) {
+        std::string op(opView);
 #ifdef DEBUG
-        std::cout << "Received message from a client: " << iss.str() << std::endl;
+        std::cout << "Received message from a client: " << op << std::endl;
 #endif
-        getline(iss, op); // extract operation code from the 1st line
 
         if (op == MSG_LOGIN_REQUEST) {
-            std::string login_info, username, password, loginRes;
-            getline(iss, login_info); // extract login info from the second line
-            getLoginInfoFromLine(login_info, username, password);
+            std::string_view username, password;
+            scanLoginInfo(data, username, password);
             tryLogin(childSockfd, username, password);
         }
-        else if (loginStatuses[childSockfd].loggedIn) {
-            std::string roomcode, backendServerName, msg;
-
-            getline(iss, roomcode); // extract roomcode from the second line
-            backendServerName = roomcode.substr(0, 1);
+        else if (op == MSG_RESUME_REQUEST) {
+            tryResume(childSockfd, std::string(data));
+        }
+        else if ((op == MSG_CHECK_BATCH || op == MSG_RESERVE_BATCH) && connections[childSockfd].loginStatus.loggedIn) {
+            handleBatchRequest(childSockfd, op, std::string(seqView), data);
+        }
+        else if ((op == MSG_CHECK_REQUEST || op == MSG_RESERVE_REQUEST) && connections[childSockfd].loginStatus.loggedIn) {
+            struct LoginStatus& loginStatus = connections[childSockfd].loginStatus;
+            std::string seq(seqView); // echoed in the reply
+            std::string roomcode(data);
+            std::string backendServerName = server.shards.route(roomcode);
 #ifdef DEBUG
             std::cout << "Roomcode: " << roomcode  <<
-                "Extracted roomtype: " << backendServerName << std::endl;
+                "Routed to backend server: " << backendServerName << std::endl;
 #endif
 
             if (op == MSG_CHECK_REQUEST) {
                 std::cout << "The main server has received the availability request on Room " << roomcode << " from "
-                << loginStatuses[childSockfd].username << " using TCP over port " << port_TCP << "." << std::endl;
+                << loginStatus.username << " using TCP over port " << server.port_TCP << "." << std::endl;
             } else if (op == MSG_RESERVE_REQUEST) {
                 std::cout << "The main server has received the reservation request on Room " << roomcode << " from "
-                << loginStatuses[childSockfd].username << " using TCP over port " << port_TCP << "." << std::endl;
-
-                if (!loginStatuses[childSockfd].isMember) {
-                    std::cout << loginStatuses[childSockfd].username << " cannot make a reservation." << std::endl;
-                    msg = MSG_RESERVE_DENIED;
-                    if (send(childSockfd, msg.c_str(), msg.length(), 0) == -1) {
-                        perror(("Send to client: " + msg).c_str());
-                        exit(1);
+                << loginStatus.username << " using TCP over port " << server.port_TCP << "." << std::endl;
+
+                if (!loginStatus.isMember) {
+                    std::cout << loginStatus.username << " cannot make a reservation." << std::endl;
+                    if (!replyToClient(childSockfd, MSG_RESERVE_DENIED, seq)) {
+                        return;
                     }
                     std::cout << "The main server sent the error message to the client." << std::endl;
-                    return true;
+                    return;
                 }
             }
 
+            if (op == MSG_CHECK_REQUEST && server.cacheEnabled && answerFromCache(childSockfd, roomcode, seq)) {
+                return;
+            }
+
             // In other cases, forward request to backend servers if the corresponding backend server exists.
-            if (backendServers.find(backendServerName) == backendServers.end()) {
-                // incorrect input roomcode (doesn't start with "S"/"D"/"U")
-                std::string msg_onscreen;
+            if (server.backendServers.find(backendServerName) == server.backendServers.end()) {
+                // incorrect input roomcode (no backend server serves its building type)
+                std::string msg, msg_onscreen;
                 if (op == MSG_CHECK_REQUEST) {
                     msg = MSG_CHECK_NOTFOUND;
                     msg_onscreen =  "The main server sent the availability information to the client.";
                 }
-                else if (op == MSG_RESERVE_REQUEST) {
+                else {
                     msg = MSG_RESERVE_NOTFOUND;
                     msg_onscreen =  "The main server sent the reservation result to the client.";
                 }
                 // directly send reply to client
-                if (send(childSockfd, msg.c_str(), msg.length(), 0) == -1) {
-                    perror(("Send to client: " + msg).c_str());
-                    exit(1);
+                if (!replyToClient(childSockfd, msg, seq)) {
+                    return;
                 }
                 std::cout << msg_onscreen << std::endl;
-            } else { // forward request to a backend server
-                msg = op + "\n" + std::to_string(childSockfd) + "\n" + roomcode;
-                if (sendto(sockfd_UDP, msg.c_str(), msg.length(), 0,
-                    backendServers[backendServerName]->ai_addr, backendServers[backendServerName]->ai_addrlen) == -1) {
-                    perror("Server M: sendto");
-                    exit(1);
+            } else { // forward request to a backend server; availability checks may go to a replica
+                if (op == MSG_CHECK_REQUEST) {
+                    backendServerName = readTarget(backendServerName);
                 }
+                struct InflightRequest request;
+                request.childSockfd = childSockfd;
+                request.connectionId = connections[childSockfd].connectionId;
+                request.seq = seq;
+                request.backendServerName = backendServerName;
+                request.roomcode = roomcode;
+                request.batchId = 0;
+                request.retransmits = 0;
+                request.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+                uint64_t requestId = inflight.insert(request);
+
+                struct InflightRequest *stored = inflight.find(requestId);
+                stored->msg = op + "\n" + wireIdOf(requestId) + "\n" + roomcode;
+                timeouts.emplace_back(stored->deadline, requestId);
+                sendToBackend(*stored);
                 std::cout << "The main server sent a request to Server " << backendServerName << "." << std::endl;
             }
         }
-        return true;
+    }
+
+
+    /**
+     * recv from a client over the TCP port, and react to every complete message received so far.
+     * A client may pipeline many requests, so one recv() may carry several messages or part of one.
+     * @param childSockfd child socket file descripter
+     * @return false iff connection is closed
+     */
+    bool handleClient(int childSockfd) {
+        int numbytes; // number of bytes received
+        char buf[MAXBUFLEN];
+
+        numbytes = recv(childSockfd, buf, MAXBUFLEN, 0);
+        if (numbytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return true;
+            }
+            if (errno != ECONNRESET) { // a reset is just an abrupt close
+                perror("recv");
+            }
+            return false;
+        }
+        if (numbytes == 0) {
+            return false;
+        }
+        struct ClientConnection& conn = connections[childSockfd];
+        conn.inBuf.append(buf, numbytes);
+        if (conn.protocol == WIRE_UNDECIDED) { // text messages start with a letter, binary frames with BINARY_MAGIC
+            conn.protocol = (uint8_t)conn.inBuf[0] == BINARY_MAGIC ? WIRE_BINARY : WIRE_TEXT;
+        }
+
+        size_t pos = 0; // start of the first message not handled yet
+        if (conn.protocol == WIRE_BINARY) {
+            // frames are decoded in place: the views handed on point into inBuf, which is left alone until the end
+            struct BinaryFrame frame;
+            long taken;
+            char seq[24];
+            while ((taken = decodeFrame(conn.inBuf.data() + pos, conn.inBuf.length() - pos, frame)) > 0) {
+                pos += taken;
+                int seqLen = snprintf(seq, sizeof seq, "%llu", (unsigned long long)frame.requestId);
+                std::string_view data = frame.op == MSG_CHECK_REQUEST || frame.op == MSG_RESERVE_REQUEST ?
+                    roomcodeOf(frame.payload) : frame.payload;
+                handleClientMessage(childSockfd, frame.op, std::string_view(seq, seqLen), data);
+                if (connections.find(childSockfd) == connections.end()) { // closed while replying
+                    return true;
+                }
+            }
+            if (taken == -1) { // not a valid frame
+                return false;
+            }
+        }
+        else {
+            std::vector<std::string> fields;
+            while (takeMessage(conn.inBuf, pos, fields)) {
+                if (fields[0] == MSG_LOGIN_REQUEST || fields[0] == MSG_RESUME_REQUEST) {
+                    handleClientMessage(childSockfd, fields[0], "", fields[1]);
+                } else if (fields.size() == 3) {
+                    handleClientMessage(childSockfd, fields[0], fields[1], fields[2]);
+                }
+                if (connections.find(childSockfd) == connections.end()) { // closed while replying
+                    return true;
+                }
+            }
+        }
+        conn.inBuf.erase(0, pos);
+        // a message never gets this long; the client is not speaking the protocol
+        return conn.inBuf.length() <= MAX_PENDING_INPUT;
+    }
+
+
+    /**
+     * Accept all pending client connections and register them to the epoll instance.
+     */
+    void acceptClients() { // reused code from Beej's Guide 6.1
+        int new_fd; // child socket filedescripter
+        struct sockaddr_storage their_addr; // connector's address information
+        socklen_t sin_size;
+
+        while (true) {
+            sin_size = sizeof their_addr;
+            new_fd = accept(this->sockfd_TCP, (struct sockaddr *)&their_addr, &sin_size);
+            if (new_fd == -1) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    perror("accept");
+                }
+                return;
+            }
+            if (!setNonBlocking(new_fd) || !watch(new_fd, EPOLLIN, EPOLL_CTL_ADD)) {
+                close(new_fd);
+                continue;
+            }
+            struct ClientConnection newConn;
+            newConn.connectionId = nextConnectionId++;
+            newConn.protocol = WIRE_UNDECIDED;
+            newConn.loginStatus = {"", false, false};
+            connections[new_fd] = newConn;
+        }
     }
 
 
 public:
-    MainServer(const std::string& hostAddress, const std::string& UDPport, const std::string& TCPport) {
-        this->hostAddress = hostAddress;
-        this->port_UDP = UDPport;
-        this->port_TCP = TCPport;
+    Reactor(MainServerData& server, int reactorId) : server(server), inflight(reactorId) {
+        this->reactorId = reactorId;
+        this->nextConnectionId = 0;
         this->sockfd_UDP = -1;
         this->sockfd_TCP = -1;
+        this->epollfd = -1;
     }
 
-    ~MainServer() {
-        for (const auto& pair : backendServers) {
-            freeaddrinfo(pair.second);
-        }
+    ~Reactor() {
         if (sockfd_UDP != -1) {
             close(sockfd_UDP);
         }
         if (sockfd_TCP != -1) {
             close(sockfd_TCP);
         }
+        for (const auto& pair : connections) {
+            close(pair.first);
+        }
+        if (epollfd != -1) {
+            close(epollfd);
+        }
     }
 
 
     /**
-     * Creat & bind a UDP socket and a TCP socket
+     * Creat & bind a UDP socket and a TCP socket.
+     * Reactor 0 binds the designated UDP port (where backend servers send INIT); the others bind an ephemeral one.
      * @return whether successful or not
      */
     bool bootup() {
@@ -325,11 +1595,14 @@ public:
         hints_TCP.ai_socktype = SOCK_STREAM; // use TCP
 
         struct addrinfo *SMInfo_UDP, *SMInfo_TCP;
-        struct sigaction sa;
+        struct sockaddr_in UDPAddr;
+        socklen_t addrLen = sizeof(UDPAddr);
+        int yes = 1;
 
 
-        // Create a UDP socket and bind to the designated port
-        if (getaddrinfo(hostAddress.c_str(), port_UDP.c_str(), &hints_UDP, &SMInfo_UDP) != 0) {
+        // Create a UDP socket and bind to the designated (reactor 0) or an ephemeral port
+        std::string bindPort_UDP = reactorId == 0 ? server.port_UDP : "0";
+        if (getaddrinfo(server.hostAddress.c_str(), bindPort_UDP.c_str(), &hints_UDP, &SMInfo_UDP) != 0) {
             perror("ServerM UDP: getaddrinfo");
             return false;
         }
@@ -340,13 +1613,20 @@ public:
         }
         if (bind(sockfd_UDP, SMInfo_UDP->ai_addr, SMInfo_UDP->ai_addrlen) == -1) {
             close(sockfd_UDP);
+            sockfd_UDP = -1;
             perror("ServerM UDP: bind");
             return false;
         }
         freeaddrinfo(SMInfo_UDP);
+        if (getsockname(sockfd_UDP, (struct sockaddr *)&UDPAddr, &addrLen) == -1) {
+            perror("ServerM UDP: getsockname");
+            return false;
+        }
+        port_UDP = std::to_string(ntohs(UDPAddr.sin_port));
+        batcher.reset(new DatagramBatcher(sockfd_UDP, server.udpBatchSize, MAX_DATAGRAM));
 
-        // Create a TCP socket and bind to the designated port, start listening.
-        if (getaddrinfo(hostAddress.c_str(), port_TCP.c_str(), &hints_TCP, &SMInfo_TCP) != 0) {
+        // Create a TCP socket and bind to the designated port, shared with the other reactors; start listening.
+        if (getaddrinfo(server.hostAddress.c_str(), server.port_TCP.c_str(), &hints_TCP, &SMInfo_TCP) != 0) {
             perror("ServerM TCP: getaddrinfo");
             return false;
         }
@@ -355,8 +1635,14 @@ public:
             perror("ServerM TCP: socket");
             return false;
         }
+        if (setsockopt(sockfd_TCP, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes) == -1 ||
+            setsockopt(sockfd_TCP, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes) == -1) {
+            perror("ServerM TCP: setsockopt");
+            return false;
+        }
         if (bind(sockfd_TCP, SMInfo_TCP->ai_addr, SMInfo_TCP->ai_addrlen) == -1) {
             close(sockfd_TCP);
+            sockfd_TCP = -1;
             perror("ServerM TCP: bind");
             return false;
         }
@@ -367,21 +1653,133 @@ public:
         }
 
 
-        // reused code from Beej's Guide 6.1
-        sa.sa_handler = sigchld_handler; // reap all dead processes
-        sigemptyset(&sa.sa_mask);
-        sa.sa_flags = SA_RESTART;
-        if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-            perror("sigaction");
+        // Watch the listener and the UDP socket with one epoll instance
+        if (!setNonBlocking(sockfd_UDP) || !setNonBlocking(sockfd_TCP)) {
+            perror("ServerM: fcntl");
+            return false;
+        }
+        epollfd = epoll_create1(0);
+        if (epollfd == -1) {
+            perror("epoll_create1");
+            return false;
+        }
+        if (!watch(sockfd_TCP, EPOLLIN, EPOLL_CTL_ADD) || !watch(sockfd_UDP, EPOLLIN, EPOLL_CTL_ADD)) {
             return false;
         }
+        return true;
+    }
+
+
+    /**
+     * Event loop: wait on the listener, all child sockets and the UDP socket, and react to whichever is ready.
+     * Clients are multiplexed in this single process instead of being forked.
+     */
+    void run() {
+        struct epoll_event events[MAX_EVENTS];
+
+        // Main loop
+        while (true) {
+            int numEvents = epoll_wait(epollfd, events, MAX_EVENTS, nextTimeoutMs());
+            if (numEvents == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("epoll_wait");
+                exit(1);
+            }
+            for (int i = 0; i < numEvents; i++) {
+                int fd = events[i].data.fd;
+                if (fd == sockfd_TCP) {
+                    acceptClients();
+                }
+                else if (fd == sockfd_UDP) {
+                    while (handleBackendServer()) {}
+                }
+                else if (connections.find(fd) != connections.end()) {
+                    if ((events[i].events & EPOLLOUT) && !flushClient(fd)) {
+                        continue;
+                    }
+                    if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !handleClient(fd)) {
+                        closeClient(fd);
+                    }
+                }
+            }
+            expireRequests();
+            flushBackendRequests(false);
+        }
+    }
+
+
+};
+
+
+/**
+ * The main server: owns the data shared by all reactors and runs one reactor per thread.
+ */
+class MainServer {
+private:
+    MainServerData server;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::string memberFile; // where the member data was read from, read again on RELOAD_SIGNAL
+
+public:
+    MainServer(const std::string& hostAddress, const std::string& UDPport, const std::string& TCPport) {
+        server.hostAddress = hostAddress;
+        server.port_UDP = UDPport;
+        server.port_TCP = TCPport;
+        server.epoch = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+        blockReloadSignal();
+    }
+
+    /**
+     * Answer availability checks from the cache of all room data, instead of forwarding them to backend servers
+     */
+    void enableCache() {
+        server.cacheEnabled = true;
+    }
+
+    /**
+     * Set how requests to backend servers are batched; call before bootup()
+     * @param batchSize max datagrams per recvmmsg/sendmmsg call
+     * @param flushLatencyUs max time a request waits for more requests to share its sendmmsg call
+     */
+    void setBatching(size_t batchSize, long flushLatencyUs) {
+        server.udpBatchSize = std::max<size_t>(1, batchSize);
+        server.udpFlushLatencyUs = std::max(0L, flushLatencyUs);
+    }
+
+    ~MainServer() {
+        reactors.clear();
+        for (const auto& pair : server.backendServers) {
+            freeaddrinfo(pair.second);
+        }
+    }
 
 
+    /**
+     * Create and boot up all reactors
+     * @param numReactors number of reactor threads
+     * @return whether successful or not
+     */
+    bool bootup(int numReactors) {
+        for (int i = 0; i < numReactors; i++) {
+            reactors.emplace_back(new Reactor(server, i));
+            if (!reactors.back()->bootup()) {
+                return false;
+            }
+        }
         std::cout << "The main server is up and running." << std::endl;
         return true;
     }
 
-    
+
+    /**
+     * Add a backend server to forward requests to
+     * @param serverName name of the backend server, as in the backends configuration
+     * @param hostAddress host address of the backend server
+     * @param UDPport UDP port of the backend server
+     * @return whether successful or not
+     */
     bool addBackendServers(const std::string& serverName, const std::string& hostAddress, const std::string& UDPport) {
         struct addrinfo hints_UDP;
         memset(&hints_UDP, 0, sizeof hints_UDP);
@@ -389,107 +1787,159 @@ public:
         hints_UDP.ai_socktype = SOCK_DGRAM; // use UDP
 
         struct addrinfo *serverInfo;
-        if (getaddrinfo(hostAddress.c_str(), UDPport.c_str(), &hints_UDP, &serverInfo) != 0) { // Server S
+        if (getaddrinfo(hostAddress.c_str(), UDPport.c_str(), &hints_UDP, &serverInfo) != 0) {
             perror(("Server"+ serverName +": getaddrinfo").c_str());
             return false;
         }
-        backendServers[serverName] = serverInfo;
+        server.backendServers[serverName] = serverInfo;
+        server.backendNames[addressKeyOf(*(const struct sockaddr_in *)serverInfo->ai_addr)] = serverName;
+        server.updateVersions[serverName] = 0;
         return true;
     }
 
 
     /**
-     *  * Read from input file, store member data into memberData
-     * @param file input file path + name
+     * Add every backend server of a backends configuration file, and route requests among them
+     * @param file backends configuration file path; the default S, D and U backend servers if there is none
+     * @return whether successful or not
      */
-    void initMemberDataFromFile(const std::string& file) {
-        std::ifstream inFile(file);
-        std::regex re("([^,]{5,50}),\\s(.{5,50})");
-        std::smatch match;
-        std::string line;
-        std::string username, password;
-        while (getline(inFile, line)) {
-            if (regex_search(line, match, re)) {
-                username = match[1].str();
-                password = match[2].str();
+    bool addBackendServers(const std::string& file) {
+        if (!server.shards.load(file)) {
+            return false;
+        }
+        for (const BackendShard& shard : server.shards.all()) {
+            if (!addBackendServers(shard.name, shard.hostAddress, shard.port)) {
+                return false;
+            }
+            if (!shard.primary.empty()) {
+                server.replicas[shard.primary].push_back(shard.name);
+                server.replicaStatus[shard.name];
             }
-            memberData[username] = password;
         }
+        return true;
     }
 
 
     /**
-     * Keep accepting new client connections. Deal with clients.
+     *  * Read from input file, store member data into the member index
+     * @param file input file path + name
      */
-    void handleMultipleClients() { // reused code from Beej's Guide 6.1
-        int new_fd; // child socket filedescripter
-        struct sockaddr_storage their_addr; // connector's address information
-        socklen_t sin_size;
-
-        // Main loop
-        while (true) {
-            sin_size = sizeof their_addr;
-            new_fd = accept(this->sockfd_TCP, (struct sockaddr *)&their_addr, &sin_size);
-            if (new_fd == -1) {
-                perror("accept");
-                continue;
-            }
-            struct LoginStatus defaultLoginStat= {"", false, false};
-            loginStatuses[new_fd] = defaultLoginStat;
+    void initMemberDataFromFile(const std::string& file) {
+        memberFile = file;
+        std::shared_ptr<const MemberIndex> members = readMemberFile(file);
+        if (members != nullptr) { // without a member file, nobody logs in as a member
+            std::atomic_store(&server.members, members);
+        }
+    }
 
-            pid_t pid = fork();
 
-            if (pid == -1) {
-                // Error occurred
-                std::cerr << "Error in fork()" << std::endl;
-                exit(1);
-            }
-            if (pid == 0) { // this is the child process
-                close(this->sockfd_TCP); // child doesn't need the listener
-                while (true) {
-                    if (!this->handleClient(new_fd)) {
-                        break;
-                    }
-                }
-                close(new_fd);
-                exit(0);
+    /**
+     * Build a member index from a member file
+     * @param file input file path + name
+     * @return the member index; nullptr if the file cannot be read
+     */
+    static std::shared_ptr<const MemberIndex> readMemberFile(const std::string& file) {
+        std::ifstream inFile(file);
+        if (!inFile) {
+            return nullptr;
+        }
+        std::shared_ptr<MemberIndex> members = std::make_shared<MemberIndex>();
+        std::string line;
+        std::string_view username, password;
+        while (getline(inFile, line)) {
+            if (scanMemberEntry(line, username, password)) {
+                members->add(username, password);
             }
-            // close(new_fd);  // parent doesn't need this
-
         }
+        members->build();
+        return members;
     }
 
 
     /**
-     * Deal will all backend servers. Keep receiving and reacting accordingly.
+     * Read the member file again and publish the new member index, while reactors keep logging clients in with
+     * the current one; logins that already loaded the current one finish with it
      */
-    void handleAllBackendServers() {
-        while (true) {
-            handleBackendServer();
+    void reloadMembers() {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const MemberIndex> members = readMemberFile(memberFile);
+        if (members == nullptr) {
+            std::cout << "The main server keeps its member data: " << memberFile << " cannot be read." << std::endl;
+            return;
         }
+        std::atomic_store(&server.members, members);
+        auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "The main server reloaded " << members->size() << " members from " << memberFile << " in "
+            << elapsedMs << " ms." << std::endl;
     }
 
 
+
+    /**
+     * Run every reactor's event loop on its own thread, and reload the member data on RELOAD_SIGNAL
+     */
+    void run() {
+        onReloadSignal([this]() { reloadMembers(); });
+        std::vector<std::thread> threads;
+        for (const auto& reactor : reactors) {
+            threads.emplace_back(&Reactor::run, reactor.get());
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
 };
 
 
-int main(){
+int main(int argc, char *argv[]){
+    // -t: number of reactor threads (at most MAX_REACTORS), defaults to the number of cores
+    // -c: answer availability checks from the cache of all room data
+    // -B: max datagrams per recvmmsg/sendmmsg call, -L: max microseconds a backend request waits for its batch to fill
+    // -b: backends configuration file, which lists the backend servers (shards) of each building type
+    int numReactors = std::min(MAX_REACTORS, (int)std::max(1u, std::thread::hardware_concurrency()));
+    bool cache = false;
+    size_t batchSize = UDP_BATCH_SIZE;
+    long flushLatencyUs = UDP_FLUSH_LATENCY_US;
+    std::string backendsConf = BACKENDS_CONF;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:cB:L:b:")) != -1) {
+        if (opt == 't' && atoi(optarg) > 0 && atoi(optarg) <= MAX_REACTORS) {
+            numReactors = atoi(optarg);
+        }
+        else if (opt == 'c') {
+            cache = true;
+        }
+        else if (opt == 'B' && atoi(optarg) > 0) {
+            batchSize = atoi(optarg);
+        }
+        else if (opt == 'L' && atol(optarg) >= 0) {
+            flushLatencyUs = atol(optarg);
+        }
+        else if (opt == 'b') {
+            backendsConf = optarg;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [-t num_reactor_threads] [-c] [-B batch_size] [-L flush_latency_us]"
+                " [-b backends_conf]" << std::endl;
+            return 1;
+        }
+    }
+
     MainServer serverS(LOCAL_HOST, PORT_SM_UDP, PORT_SM_TCP);
-    if(!serverS.bootup()) {
+    serverS.setBatching(batchSize, flushLatencyUs);
+    if (cache) {
+        serverS.enableCache();
+    }
+    if (!serverS.addBackendServers(backendsConf)) {
+        return 1;
+    }
+    if(!serverS.bootup(numReactors)) {
         return 1;
     }
-    serverS.addBackendServers("S", LOCAL_HOST, PORT_SS_UDP);
-    serverS.addBackendServers("D", LOCAL_HOST, PORT_SD_UDP);
-    serverS.addBackendServers("U", LOCAL_HOST, PORT_SU_UDP);
     serverS.initMemberDataFromFile("member.txt");
 
-    // one thread for handling backend servers over UDP socket
-    // another thread for handling clients over TCP socket
-    std::thread t1(&MainServer::handleAllBackendServers, &serverS);
-    std::thread t2(&MainServer::handleMultipleClients, &serverS);
-
-    t1.join();
-    t2.join();
+    // each reactor thread handles its own clients over TCP and its own backend replies over UDP
+    serverS.run();
 
     return 0;
 }
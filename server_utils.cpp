@@ -3,6 +3,146 @@
 // #define DEBUG
 
 
+// Hand-written scanners with the same acceptance rules as the regular expressions noted on each of them
+// (std::regex, ECMAScript grammar, C locale): one pass over the line, no regex construction, no allocation.
+
+
+// characters matched by "." : anything but line terminators
+static inline bool isLineChar(char c) {
+    return c != '\n' && c != '\r';
+}
+
+
+// characters matched by "\s"
+static inline bool isSpaceChar(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+
+/**
+ * Split "username,password" like regex_search with "([^,]*),(.*)"
+ * @param line input string
+ * @param username to store the part before the first comma
+ * @param password to store the part after it, up to the first line terminator
+ * @return whether the line matches
+ */
+bool scanLoginInfo(std::string_view line, std::string_view& username, std::string_view& password) {
+    size_t comma = line.find(',');
+    if (comma == std::string_view::npos) {
+        return false;
+    }
+    size_t end = comma + 1;
+    while (end < line.length() && isLineChar(line[end])) {
+        end++;
+    }
+    username = line.substr(0, comma);
+    password = line.substr(comma + 1, end - comma - 1);
+    return true;
+}
+
+
+/**
+ * Split "roomcode, available number" like regex_search with "([^,]+),\s*(\d+)"
+ * @param line input string
+ * @param roomcode to store the roomcode
+ * @param numAvailable to store the available number
+ * @return whether the line matches; numbers that do not fit in an int are rejected
+ */
+bool scanRoomEntry(std::string_view line, std::string_view& roomcode, int& numAvailable) {
+    size_t segmentStart = 0; // the match starts at the beginning of the first comma-free segment that works
+    for (size_t comma = line.find(','); comma != std::string_view::npos;
+         segmentStart = comma + 1, comma = line.find(',', comma + 1)) {
+        if (comma == segmentStart) { // "[^,]+" needs at least one character
+            continue;
+        }
+        size_t cur = comma + 1;
+        while (cur < line.length() && isSpaceChar(line[cur])) {
+            cur++;
+        }
+        if (cur == line.length() || !isdigit((unsigned char)line[cur])) {
+            continue;
+        }
+        long long num = 0;
+        for (; cur < line.length() && isdigit((unsigned char)line[cur]); cur++) {
+            num = num * 10 + (line[cur] - '0');
+            if (num > INT_MAX) {
+                return false;
+            }
+        }
+        roomcode = line.substr(segmentStart, comma - segmentStart);
+        numAvailable = (int)num;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Split a member file line like regex_search with "([^,]{5,50}),\s(.{5,50})"
+ * @param line input string
+ * @param username to store the (at most 50) characters before the comma
+ * @param password to store the (at most 50) characters after the comma and one whitespace
+ * @return whether the line matches
+ */
+bool scanMemberEntry(std::string_view line, std::string_view& username, std::string_view& password) {
+    size_t segmentStart = 0;
+    for (size_t comma = line.find(','); comma != std::string_view::npos;
+         segmentStart = comma + 1, comma = line.find(',', comma + 1)) {
+        size_t start = std::max(segmentStart, comma >= 50 ? comma - 50 : 0); // leftmost start reaching the comma
+        if (comma - start < 5 || comma + 1 >= line.length() || !isSpaceChar(line[comma + 1])) {
+            continue;
+        }
+        size_t end = comma + 2;
+        while (end < line.length() && end - (comma + 2) < 50 && isLineChar(line[end])) {
+            end++;
+        }
+        if (end - (comma + 2) < 5) {
+            continue;
+        }
+        username = line.substr(start, comma - start);
+        password = line.substr(comma + 2, end - comma - 2);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Check a username like regex_match with "[a-z]{5,50}"
+ * @param username (encrypted) username
+ * @return whether valid
+ */
+bool isValidUsername(std::string_view username) {
+    if (username.length() < 5 || username.length() > 50) {
+        return false;
+    }
+    for (char c : username) {
+        if (c < 'a' || c > 'z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Check a password like regex_match with ".{5,50}"
+ * @param password (encrypted) password
+ * @return whether valid
+ */
+bool isValidPassword(std::string_view password) {
+    if (password.length() < 5 || password.length() > 50) {
+        return false;
+    }
+    for (char c : password) {
+        if (!isLineChar(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 /**
  * Read from input string of log in information (form: "username,password"),
  * get username and password
@@ -11,11 +151,10 @@
  * @param password: to store the extracted password
  */
 void getLoginInfoFromLine(const std::string& line, std::string& username, std::string& password) {
-    std::regex re("([^,]*),(.*)");
-    std::smatch match;
-    if (regex_search(line, match, re)){
-        username = match[1].str();
-        password = match[2].str();
+    std::string_view usernameView, passwordView;
+    if (scanLoginInfo(line, usernameView, passwordView)) {
+        username = usernameView;
+        password = passwordView;
     }
 }
 
@@ -28,11 +167,9 @@ void getLoginInfoFromLine(const std::string& line, std::string& username, std::s
  * @param numAvailable: to store the extracted available number
  */
 void getDataFromLine(const std::string& line, std::string& roomcode, int& numAvailable) {
-    std::regex re("([^,]+),\\s*(\\d+)");
-    std::smatch match;
-    if (regex_search(line, match, re)){
-        roomcode = match[1].str();
-        numAvailable =  stoi(match[2].str());
+    std::string_view roomcodeView;
+    if (scanRoomEntry(line, roomcodeView, numAvailable)) {
+        roomcode = roomcodeView;
     }
 }
 
@@ -44,12 +181,10 @@ void getDataFromLine(const std::string& line, std::string& roomcode, int& numAva
  * @param mymap: the map to add entries to; entries with the same key will be overwritten.
  */
 void addLineToMap(const std::string& line, std::map<std::string, int>& mymap) {
-    std::regex re("([^,]+),\\s*(\\d+)");
-    std::smatch match;
-    if (regex_search(line, match, re)){
-        std::string roomcode = match[1].str();
-        int numAvailable =  stoi(match[2].str());
-        mymap[roomcode] = numAvailable;
+    std::string_view roomcode;
+    int numAvailable;
+    if (scanRoomEntry(line, roomcode, numAvailable)) {
+        mymap[std::string(roomcode)] = numAvailable;
     }
 }
 
@@ -69,28 +204,62 @@ std::string dataToStr(std::map<std::string, int> const& mymap) {
 
 
 /**
- * Get the name of the server from the address & port
- * @param address IP address
- * @param port port number
- * @return A string representing the server's name
+ * Number of lines following the op code line in a message over TCP between a client and the main server
+ * @param op op code
+ * @return number of lines
  */
-std::string portToServerName(const std::string& address, const std::string& port) {
-    if (address == LOCAL_HOST) {
-        if (port == PORT_SS_UDP) {
-            return "S";
-        }
-        if (port == PORT_SD_UDP) {
-            return "D";
-        }
-        if (port == PORT_SU_UDP) {
-            return "U";
+int numFieldsOf(const std::string& op) {
+    if (op == MSG_LOGIN_REQUEST) {
+        return 1; // login info
+    }
+    if (op == MSG_RESUME_REQUEST || op == MSG_SESSION_TOKEN) {
+        return 1; // session token
+    }
+    if (op == MSG_CHECK_REQUEST || op == MSG_RESERVE_REQUEST) {
+        return 2; // sequence number, roomcode
+    }
+    if (op == MSG_CHECK_BATCH || op == MSG_RESERVE_BATCH) {
+        return 2; // sequence number, comma-separated roomcodes
+    }
+    if (op == MSG_CHECK_BATCH_RESULT || op == MSG_RESERVE_BATCH_RESULT) {
+        return 2; // sequence number, comma-separated result op codes
+    }
+    if (op.compare(0, 3, MSG_LOGIN_REQUEST "_") == 0) {
+        return 0; // login results carry no data
+    }
+    if (op.compare(0, 3, MSG_CHECK_REQUEST "_") == 0 || op.compare(0, 3, MSG_RESERVE_REQUEST "_") == 0
+        || op == MSG_REQUEST_TIMEOUT) {
+        return 1; // sequence number of the request
+    }
+    return 0;
+}
+
+
+/**
+ * Take one complete message out of a TCP stream buffer. Every line of a message over TCP ends with "\n",
+ * and the number of lines following the op code line is fixed by the op code (see numFieldsOf).
+ * @param buf receive buffer
+ * @param pos offset of the first unparsed byte; moved past the message if it is complete
+ * @param fields to store the op code and the lines following it
+ * @return whether a complete message was taken
+ */
+bool takeMessage(const std::string& buf, size_t& pos, std::vector<std::string>& fields) {
+    fields.clear();
+    size_t cur = pos;
+    int numLines = 1;
+    while ((int)fields.size() < numLines) {
+        size_t end = buf.find('\n', cur);
+        if (end == std::string::npos) {
+            return false; // wait for the rest of the message
         }
-        if (port == PORT_SM_UDP || port == PORT_SM_TCP) {
-            return "M";
+        fields.push_back(buf.substr(cur, end - cur));
+        cur = end + 1;
+        if (fields.size() == 1) {
+            numLines += numFieldsOf(fields[0]);
         }
     }
-    std::cout << "No matching server found" << std::endl;
-    return "";
+    pos = cur;
+    return true;
 }
 
 
@@ -105,6 +274,145 @@ void *get_in_addr(struct sockaddr *sa)
 }
 
 
+/**
+ * Put a socket into non-blocking mode
+ * @param fd socket file descripter
+ * @return whether successful or not
+ */
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+
+/**
+ * Block RELOAD_SIGNAL in the calling thread and in the threads it starts from then on, so it is only taken by
+ * the thread onReloadSignal() starts; call before starting any other thread
+ */
+void blockReloadSignal() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, RELOAD_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+
+/**
+ * Start a thread that calls a function every time the process gets RELOAD_SIGNAL; signals that arrive while the
+ * function runs are merged into one more call
+ * @param reload the function
+ */
+void onReloadSignal(std::function<void()> reload) {
+    std::thread([reload]() {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, RELOAD_SIGNAL);
+        int signal;
+        while (sigwait(&signals, &signal) == 0) {
+            reload();
+        }
+    }).detach();
+}
+
+
+DatagramBatcher::DatagramBatcher(int sockfd, size_t batchSize, size_t maxDatagram)
+    : sockfd(sockfd), batchSize(std::max<size_t>(1, batchSize)), maxDatagram(maxDatagram),
+      recvBuf(this->batchSize * (maxDatagram + 1)), recvMsgs(this->batchSize), recvIovs(this->batchSize),
+      recvAddrs(this->batchSize) {
+}
+
+
+int DatagramBatcher::receive(int flags) {
+    for (size_t i = 0; i < batchSize; i++) {
+        recvIovs[i].iov_base = &recvBuf[i * (maxDatagram + 1)];
+        recvIovs[i].iov_len = maxDatagram;
+        memset(&recvMsgs[i], 0, sizeof recvMsgs[i]);
+        recvMsgs[i].msg_hdr.msg_iov = &recvIovs[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+        recvMsgs[i].msg_hdr.msg_namelen = sizeof recvAddrs[i];
+    }
+    int numReceived = recvmmsg(sockfd, recvMsgs.data(), batchSize, flags, nullptr);
+    if (numReceived == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    for (int i = 0; i < numReceived; i++) {
+        recvBuf[i * (maxDatagram + 1) + recvMsgs[i].msg_len] = '\0';
+    }
+    numRecvCalls++;
+    this->numReceived += numReceived;
+    return numReceived;
+}
+
+
+bool DatagramBatcher::queue(const std::string& msg, const struct sockaddr *addr, socklen_t addrLen) {
+    if (outMsgs.empty()) {
+        firstQueued = std::chrono::steady_clock::now();
+    }
+    outMsgs.push_back(msg);
+    outAddrs.emplace_back();
+    memcpy(&outAddrs.back(), addr, std::min<size_t>(addrLen, sizeof(struct sockaddr_storage)));
+    outAddrLens.push_back(addrLen);
+    return outMsgs.size() < batchSize || flush();
+}
+
+
+bool DatagramBatcher::flush() {
+    std::vector<struct mmsghdr> msgs(outMsgs.size());
+    std::vector<struct iovec> iovs(outMsgs.size());
+    for (size_t i = 0; i < outMsgs.size(); i++) {
+        iovs[i].iov_base = &outMsgs[i][0];
+        iovs[i].iov_len = outMsgs[i].length();
+        memset(&msgs[i], 0, sizeof msgs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &outAddrs[i];
+        msgs[i].msg_hdr.msg_namelen = outAddrLens[i];
+    }
+    bool ok = true;
+    size_t sent = 0;
+    while (sent < msgs.size()) {
+        int numSentNow = sendmmsg(sockfd, &msgs[sent], std::min(batchSize, msgs.size() - sent), 0);
+        if (numSentNow == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // no buffer space: drop the rest, the main server retransmits
+            ok = errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+            break;
+        }
+        numSendCalls++;
+        numSent += numSentNow;
+        sent += numSentNow;
+    }
+    outMsgs.clear();
+    outAddrs.clear();
+    outAddrLens.clear();
+    return ok;
+}
+
+
+bool DatagramBatcher::reportDue() {
+    if (numReceived < nextReport) {
+        return false;
+    }
+    nextReport = (numReceived / UDP_REPORT_INTERVAL + 1) * UDP_REPORT_INTERVAL;
+    return true;
+}
+
+
+std::string DatagramBatcher::statsStr() const {
+    std::ostringstream oss;
+    oss << "(" << numReceived << " datagrams in " << numRecvCalls << " recvmmsg calls, "
+        << (numRecvCalls ? (double)numReceived / numRecvCalls : 0) << " per call; " << numSent << " datagrams in "
+        << numSendCalls << " sendmmsg calls, " << (numSendCalls ? (double)numSent / numSendCalls : 0) << " per call)";
+    return oss.str();
+}
+
+
 
 // class BackendServer implementation
 
@@ -114,6 +422,7 @@ BackendServer::BackendServer(const std::string& serverName, const std::string& h
     this->hostAddress = hostAddress;
     this->port_UDP = UDPport;
     this->sockfd_UDP = -1;
+    blockReloadSignal();
 }
 
 
@@ -125,162 +434,1486 @@ BackendServer::~BackendServer() {
 
 
 /**
- * Read from input file, store data into roomData
- * @param file: input file path + name
+ * Scan every "roomcode, available number" line in a range of a memory-mapped input file
+ * @param begin first byte of the range, at the start of a line
+ * @param end one past the last byte of the range, at the start of a line or the end of the file
+ * @param entries to store the valid entries in file order; roomcodes point into the mapped file
  */
-void BackendServer::initDataFromFile(const std::string& file) {
-    std::ifstream inFile(file);
-    std::regex re("([^,]+),\\s*(\\d+)");
-    std::smatch match;
-    std::string line;
-    std::string roomcode;
+static void scanRoomLines(const char *begin, const char *end, std::vector<std::pair<std::string_view, int>>& entries) {
+    std::string_view roomcode;
     int numAvailable;
-    while (getline(inFile, line)) {
-        if (regex_search(line, match, re)) {
-            roomcode = match[1].str();
-            numAvailable =  stoi(match[2].str());
+    while (begin < end) {
+        const char *newline = (const char *)memchr(begin, '\n', end - begin);
+        const char *lineEnd = newline == nullptr ? end : newline;
+        if (scanRoomEntry(std::string_view(begin, lineEnd - begin), roomcode, numAvailable)) {
+            entries.emplace_back(roomcode, numAvailable);
         }
-        roomData[roomcode] = numAvailable;
+        begin = lineEnd + 1;
     }
 }
 
 
 /**
- * Creat & bind a UDP socket
- * @return whether successful or not
+ * Path of the room table file converted from a text room inventory: its extension replaced by ".rtab"
+ * @param file text input file path + name, e.g. "single.txt"
+ * @return room table file path, e.g. "single.rtab"
  */
-bool BackendServer::bootup() {
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET; // use IPv4
-    hints.ai_socktype = SOCK_DGRAM; // use UDP
+std::string tableFileOf(const std::string& file) {
+    size_t dot = file.rfind('.');
+    size_t slash = file.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return file + ".rtab";
+    }
+    return file.substr(0, dot) + ".rtab";
+}
 
-    struct addrinfo *serverInfo;
 
-    // Create a UDP socket and bind to the designated port
-    if (getaddrinfo(hostAddress.c_str(), port_UDP.c_str(), &hints, &serverInfo) != 0) {
-        perror(("Server" + serverName + ": getaddrinfo").c_str());
+/**
+ * Read a text room inventory ("roomcode, available number" lines) into a room table.
+ * The file is memory-mapped and split at line boundaries into chunks that are scanned in parallel,
+ * then the entries are inserted in file order (so a later line for the same roomcode still wins).
+ * @param file input file path + name
+ * @param rooms room table to add the entries to
+ * @return whether successful or not
+ */
+bool loadRoomFile(const std::string& file, RoomIndex& rooms) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1) {
+        perror(("open " + file).c_str());
         return false;
     }
-    sockfd_UDP = socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol);
-    if (sockfd_UDP == -1) {
-        perror(("Server" + serverName + ": socket").c_str());
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
+        perror(("fstat " + file).c_str());
+        close(fd);
         return false;
     }
-    if (bind(sockfd_UDP, serverInfo->ai_addr, serverInfo->ai_addrlen) == -1) {
-        close(sockfd_UDP);
-        perror(("Server" + serverName + ": bind").c_str());
+    if (fileStat.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    size_t size = fileStat.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(("mmap " + file).c_str());
         return false;
     }
-    freeaddrinfo(serverInfo);
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char *data = (const char *)mapped;
 
-    std::cout << "The Server " << serverName << " is up and running using UDP on port " << port_UDP << "." << std::endl;
+    // split into one chunk per core, each starting right after a newline
+    size_t numChunks = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), size / LOAD_CHUNK_MIN_BYTES));
+    std::vector<size_t> bounds = {0};
+    for (size_t i = 1; i < numChunks; i++) {
+        size_t pos = std::max(bounds.back(), size * i / numChunks);
+        const char *newline = (const char *)memchr(data + pos, '\n', size - pos);
+        bounds.push_back(newline == nullptr ? size : newline - data + 1);
+    }
+    bounds.push_back(size);
+
+    std::vector<std::vector<std::pair<std::string_view, int>>> entries(numChunks);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numChunks; i++) {
+        threads.emplace_back(scanRoomLines, data + bounds[i], data + bounds[i + 1], std::ref(entries[i]));
+    }
+    scanRoomLines(data + bounds[0], data + bounds[1], entries[0]);
+    for (std::thread& t : threads) {
+        t.join();
+    }
 
+    size_t numEntries = 0;
+    for (const auto& chunk : entries) {
+        numEntries += chunk.size();
+    }
+    rooms.reserve(rooms.size() + numEntries);
+    for (const auto& chunk : entries) {
+        for (const auto& entry : chunk) {
+            rooms.assign(entry.first, entry.second);
+        }
+    }
+    munmap(mapped, size);
     return true;
 }
 
 
+void BackendServer::initDataFromFile(const std::string& file) {
+    loadRoomFile(file, roomData);
+}
+
+
+bool BackendServer::initDataFromTable(const std::string& file) {
+    uint64_t lsn;
+    return roomData.map(file, lsn);
+}
+
+
+bool BackendServer::writeDataToTable(const std::string& file) const {
+    return roomData.save(file);
+}
+
+
+size_t BackendServer::numRooms() const {
+    return roomData.size();
+}
+
+
+void BackendServer::enableLog(const std::string& path, long fsyncIntervalMs, long snapshotRecords) {
+    this->logPath = path;
+    this->fsyncIntervalMs = fsyncIntervalMs;
+    this->snapshotRecords = std::max(1L, snapshotRecords);
+}
+
+
 /**
- * Stores main server information into SMinfo
- * @param hostAddress host address of the main server
- * @param UDPport the UDP port of the main server, over which the backend server communicate with the main server
+ * Resolve the UDP address of a backend server
+ * @param shard the backend server
+ * @param addr to store the address
+ * @param addrLen to store the length of addr
  * @return whether successful or not
  */
-bool BackendServer::addMainServer(const std::string& hostAddress, const std::string& UDPport) {
-    struct addrinfo hints;
+static bool resolveShard(const BackendShard& shard, struct sockaddr_storage& addr, socklen_t& addrLen) {
+    struct addrinfo hints, *info;
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_INET; // use IPv4
     hints.ai_socktype = SOCK_DGRAM; // use UDP
-
-    if (getaddrinfo(hostAddress.c_str(), UDPport.c_str(), &hints, &SMinfo) != 0) {
-        perror("ServerM: getaddrinfo");
+    if (getaddrinfo(shard.hostAddress.c_str(), shard.port.c_str(), &hints, &info) != 0) {
+        perror(("Server" + shard.name + ": getaddrinfo").c_str());
         return false;
     }
+    memcpy(&addr, info->ai_addr, info->ai_addrlen);
+    addrLen = info->ai_addrlen;
+    freeaddrinfo(info);
+    return true;
+}
+
+
+bool BackendServer::setShards(const ShardMap& shards) {
+    shardMap = shards;
+    const BackendShard *shard = shardMap.find(serverName);
+    if (shard == nullptr) {
+        return true;
+    }
+    primaryName = shard->primary;
+    if (!primaryName.empty()) {
+        return resolveShard(*shardMap.find(primaryName), primaryAddr, primaryAddrLen);
+    }
+    for (const BackendShard *replicaShard : shardMap.replicasOf(serverName)) {
+        replicaAddrs.emplace_back();
+        if (!resolveShard(*replicaShard, replicaAddrs.back().first, replicaAddrs.back().second)) {
+            return false;
+        }
+    }
     return true;
 }
 
 
+bool BackendServer::isReplica() const {
+    return !primaryName.empty();
+}
+
+
 /**
- * Send the room data with the "INIT\n" header to the main server
- * @return whether successful or not
+ * Keep only the room layouts this backend server serves, of a room table read from an input file that is shared
+ * by every shard of the building type; a replica keeps those of its primary
+ * @param rooms room table
+ */
+void BackendServer::keepOwnedRooms(RoomIndex& rooms) const {
+    const BackendShard *shard = shardMap.find(serverName);
+    const std::string& owner = isReplica() ? primaryName : serverName;
+    if (shard == nullptr || shardMap.numShardsOf(shard->buildingType) <= 1) {
+        return;
+    }
+    RoomIndex owned;
+    for (uint32_t id = 0; id < rooms.size(); id++) {
+        if (shardMap.route(rooms.code(id)) == owner) {
+            owned.assign(rooms.code(id), rooms.count(id));
+        }
+    }
+    rooms = std::move(owned);
+}
+
+
+/**
+ * Chunk boundaries for syncing replicas, the same for every sync of one room table: entries are counted at their
+ * longest. Only a primary with replicas has them.
+ * @param rooms room table
+ * @return first room ID of each chunk, plus the number of rooms; empty if this is not a primary with replicas
+ */
+std::vector<uint32_t> BackendServer::syncChunksOf(const RoomIndex& rooms) const {
+    std::vector<uint32_t> chunkStarts;
+    if (replicaAddrs.empty()) {
+        return chunkStarts;
+    }
+    chunkStarts.push_back(0);
+    size_t chunkBytes = 0;
+    for (uint32_t id = 0; id < rooms.size(); id++) {
+        size_t entryBytes = rooms.code(id).length() + 13; // "\n(roomcode),(num_available)"
+        if (chunkBytes > 0 && chunkBytes + entryBytes > SYNC_CHUNK_BYTES) {
+            chunkStarts.push_back(id);
+            chunkBytes = 0;
+        }
+        chunkBytes += entryBytes;
+    }
+    chunkStarts.push_back(rooms.size());
+    return chunkStarts;
+}
+
+
+/**
+ * Whether the room table file converted from a text room inventory can stand for it: the table exists and is not
+ * older (by modification time) than the text file, e.g. not when the text file was edited after running roomtab
+ * @param table room table file path
+ * @param file text input file path
+ * @return whether to read the table instead of the text file
  */
-bool BackendServer::sendInitDataToMainServer() const {
-    std::string roomDataToSend = MSG_INIT;
-    roomDataToSend += "\n" + dataToStr(roomData);
-    if (sendto(sockfd_UDP, roomDataToSend.c_str(), roomDataToSend.length(), 0, SMinfo->ai_addr, SMinfo->ai_addrlen) == -1) {
-        perror(("Server" + serverName + ": sendto").c_str());
+static bool isTableCurrent(const std::string& table, const std::string& file) {
+    struct stat tableStat, fileStat;
+    if (stat(table.c_str(), &tableStat) == -1) {
         return false;
     }
-    std::cout << "The Server " << serverName << " has sent the room status to the main server." << std::endl;
-    return true;
+    if (stat(file.c_str(), &fileStat) == -1) { // only the table is left
+        return true;
+    }
+    return tableStat.st_mtim.tv_sec > fileStat.st_mtim.tv_sec ||
+        (tableStat.st_mtim.tv_sec == fileStat.st_mtim.tv_sec && tableStat.st_mtim.tv_nsec >= fileStat.st_mtim.tv_nsec);
 }
 
 
 /**
-  * recvfrom the main server over the UDP port, and react accordingly.
-  */
-void BackendServer::handleMainServer() {
-    int numbytes; // number of bytes of the received datagram
-    char buf[MAXBUFLEN];
-    std::string op, childSockfdStr, roomcode, replyMsg;
+ * Read the input file, or the room table file next to it unless the input file has been changed since, keeping
+ * only the room layouts this shard serves
+ * @param rooms to store the room table
+ * @return the file read; empty if neither can be read, leaving rooms empty
+ */
+std::string BackendServer::readInventory(RoomIndex& rooms) const {
+    uint64_t lsn;
+    std::string source = tableFileOf(dataFile);
+    if (!isTableCurrent(source, dataFile) || !rooms.map(source, lsn)) {
+        source = dataFile;
+        if (!loadRoomFile(dataFile, rooms)) {
+            return "";
+        }
+    }
+    keepOwnedRooms(rooms);
+    return source;
+}
 
-    numbytes = recvfrom(sockfd_UDP, buf, MAXBUFLEN-1 , 0, SMinfo->ai_addr, &(SMinfo->ai_addrlen));
-    if (numbytes == -1) {
-        perror("recvfrom");
-        exit(1);
+
+/**
+ * Load the room data: from the snapshot and the write-ahead log if there is a snapshot, otherwise from the
+ * room table file next to the input file (e.g. single.rtab for single.txt) unless the input file has been changed
+ * since, or else the input file itself
+ * (with a write-ahead log, the first snapshot is then taken right away). Of the room table or input file, only
+ * the room layouts this shard serves are kept.
+ * @param file input file path + name
+ * @return whether successful or not
+ */
+bool BackendServer::loadData(const std::string& file) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t snapshotLsn = 0;
+    std::string source;
+    dataFile = file;
+    if (!logPath.empty() && roomData.map(logPath + ".snap", snapshotLsn)) {
+        source = logPath + ".snap";
+        readInventory(inventory); // what a reload compares the input file with
+    }
+    else { // a missing input file leaves the server without rooms, as before
+        source = readInventory(roomData);
+        if (source.empty()) {
+            source = file;
+        }
+        inventory = roomData;
     }
-    buf[numbytes] = '\0';
-    std::istringstream iss(buf);
-#ifdef DEBUG
-    std::cout << "Received message from the main server: " << iss.str() << std::endl;
-#endif
-    getline(iss, op); // extract operation code from the 1st line
-    getline(iss, childSockfdStr); // extract childSockfd as a string from the 1st line
-    getline(iss, roomcode); // extract childSockfd as a string from the 1st line
 
-    if (op == MSG_CHECK_REQUEST) {
-        std::cout << "The Server " << serverName << " received an availability request from the main server." << std::endl;
-        if (roomData.find(roomcode) != roomData.end()) {
-            if (roomData[roomcode] > 0) {
-                std::cout << "Room " << roomcode << " is available." << std::endl;
-                replyMsg = MSG_CHECK_AVAILABLE;
+    long numReplayed = 0;
+    if (!logPath.empty()) {
+        wal = std::make_unique<WriteAheadLog>();
+        numReplayed = wal->open(logPath + ".wal", fsyncIntervalMs, roomData, snapshotLsn);
+        if (numReplayed == -1) {
+            return false;
+        }
+        if (source != logPath + ".snap" && !takeSnapshot()) {
+            return false;
+        }
+    }
+    syncChunkStarts = syncChunksOf(roomData);
+    if (isReplica()) {
+        replica.roomVersions.assign(roomData.size(), 0);
+    }
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "The Server " << serverName << " loaded " << roomData.size() << " rooms from " << source;
+    if (wal) {
+        std::cout << " and replayed " << numReplayed << " logged reservations";
+    }
+    std::cout << " in " << elapsedMs << " ms." << std::endl;
+    return true;
+}
+
+
+bool BackendServer::reloadData() {
+    auto start = std::chrono::steady_clock::now();
+    RoomIndex rooms;
+    std::string source = readInventory(rooms);
+    if (source.empty()) {
+        std::cout << "The Server " << serverName << " keeps its room data: " << dataFile << " cannot be read."
+            << std::endl;
+        return false;
+    }
+    // everything proportional to the table but copying the counts is done before the swap, while workers keep
+    // serving the current table (whose layout only a reload changes)
+    RoomIndex newInventory = rooms;
+    std::vector<uint32_t> chunkStarts = syncChunksOf(rooms);
+    std::vector<uint32_t> oldIds(rooms.size()); // new ID: ID in the current table, or ROOM_NOT_FOUND if new
+    std::vector<int> capacityDeltas(rooms.size()); // new ID: rooms added (or removed, < 0) by the input file
+    for (uint32_t id = 0; id < rooms.size(); id++) {
+        oldIds[id] = roomData.find(rooms.code(id));
+        uint32_t inventoryId = inventory.find(rooms.code(id));
+        capacityDeltas[id] = rooms.count(id) - (inventoryId == ROOM_NOT_FOUND ? 0 : inventory.count(inventoryId));
+    }
+
+    RoomIndex old;
+    {
+        // no worker is in the middle of a request while the tables are swapped
+        std::unique_lock<std::shared_mutex> tableGuard(tableLock);
+        std::lock_guard<std::mutex> holdGuard(holdLock);
+        std::lock_guard<std::mutex> logGuard(logLock);
+        // a room layout of both tables keeps its live count (rooms reserved or held stay taken), changed by what
+        // the input file changed since it was last read; a new one starts with the input file's count
+        for (uint32_t id = 0; id < rooms.size(); id++) {
+            if (oldIds[id] != ROOM_NOT_FOUND) {
+                rooms.count(id) = roomData.load(oldIds[id]) + capacityDeltas[id];
             }
-            else {
-                std::cout << "Room " << roomcode << " is not available." << std::endl;
-                replyMsg = MSG_CHECK_UNAVAILABLE;
+            if (wal && capacityDeltas[id] != 0) { // so a restart from the snapshot and the log has the change too
+                wal->append(rooms.code(id), capacityDeltas[id]);
             }
         }
-        else {
-            std::cout << "Not able to find the room layout." << std::endl;
-            replyMsg = MSG_CHECK_NOTFOUND;
+        // holds move to the new table (one lookup per held room); a room layout no longer in the inventory leaves
+        // its holds
+        std::vector<int> held(roomData.size(), 0);
+        for (auto& hold : holds) {
+            std::vector<uint32_t> roomIds;
+            for (uint32_t id : hold.second.roomIds) {
+                uint32_t newId = rooms.find(roomData.code(id));
+                if (newId != ROOM_NOT_FOUND) {
+                    roomIds.push_back(newId);
+                } else {
+                    held[id]++;
+                }
+            }
+            hold.second.roomIds = std::move(roomIds);
+        }
+        if (wal) { // a removed room layout is logged down to no rooms (the snapshot counts its held rooms)
+            for (uint32_t id = 0; id < roomData.size(); id++) {
+                int numAvailable = roomData.load(id) + held[id];
+                if (numAvailable != 0 && rooms.find(roomData.code(id)) == ROOM_NOT_FOUND) {
+                    wal->append(roomData.code(id), -numAvailable);
+                }
+            }
+        }
+        old = std::move(roomData);
+        roomData = std::move(rooms);
+        inventory = std::move(newInventory);
+        syncChunkStarts = std::move(chunkStarts);
+        if (isReplica()) { // counts from the inventory are not the primary's: sync them again
+            std::lock_guard<std::mutex> replicaGuard(replicaLock);
+            replica.roomVersions.assign(roomData.size(), 0);
+            replica.synced = false;
+            replica.chunksReceived.clear();
+            replica.numChunksReceived = 0;
+            replica.syncVersion = UINT64_MAX;
+            replica.nextSyncRequest = std::chrono::steady_clock::now();
         }
-        replyMsg += "\n" + childSockfdStr;
     }
-    else if (op == MSG_RESERVE_REQUEST) {
-        std::cout << "The Server " << serverName << " received a reservation request from the main server." << std::endl;
-        if (roomData.find(roomcode) != roomData.end()) {
-            if (roomData[roomcode] > 0) {
-                roomData[roomcode] -= 1;
-                std::cout << "Successful reservation. The count of Room " << roomcode << " is now " << roomData[roomcode] << "." << std::endl;
-                replyMsg = MSG_RESERVE_SUCCEED;
-                replyMsg += "\n" + childSockfdStr + "\n" + roomcode + "," + std::to_string(roomData[roomcode]);
+    if (!commitLog()) {
+        return false;
+    }
+
+    long numChanged = 0, numRemoved = 0;
+    if (!isReplica()) {
+        DatagramBatcher batcher(sockfd_UDP, batchSize, MAX_DATAGRAM);
+        std::shared_lock<std::shared_mutex> tableGuard(tableLock);
+        for (uint32_t id = 0; id < roomData.size(); id++) {
+            uint32_t oldId = old.find(roomData.code(id));
+            int numAvailable = roomData.load(id);
+            if (oldId == ROOM_NOT_FOUND || old.count(oldId) != numAvailable) {
+                pushUpdate(std::string(roomData.code(id)), id, SMinfo->ai_addr, SMinfo->ai_addrlen, batcher);
+                replicate(id, batcher);
+                numChanged++;
             }
-            else {
-                std::cout << "Cannot make a reservation. Room " << roomcode << " is not available." << std::endl;
-                replyMsg = MSG_RESERVE_FAIL;
-                replyMsg += "\n" + childSockfdStr;
+            if (batcher.numQueued() >= batcher.getBatchSize() && !batcher.flush()) {
+                perror(("Server" + serverName + ": sendmmsg").c_str());
             }
         }
-        else {
-            std::cout << "Cannot make a reservation. Not able to find the room layout." << std::endl;
-            replyMsg = MSG_RESERVE_NOTFOUND;
-            replyMsg += "\n" + childSockfdStr;
+        for (uint32_t oldId = 0; oldId < old.size(); oldId++) {
+            if (roomData.find(old.code(oldId)) == ROOM_NOT_FOUND) {
+                pushUpdate(std::string(old.code(oldId)), ROOM_NOT_FOUND, SMinfo->ai_addr, SMinfo->ai_addrlen, batcher);
+                numRemoved++;
+            }
+            if (batcher.numQueued() >= batcher.getBatchSize() && !batcher.flush()) {
+                perror(("Server" + serverName + ": sendmmsg").c_str());
+            }
+        }
+        if (!batcher.flush()) {
+            perror(("Server" + serverName + ": sendmmsg").c_str());
         }
     }
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "The Server " << serverName << " reloaded " << roomData.size() << " rooms from " << source << " in "
+        << elapsedMs << " ms";
+    if (!isReplica()) {
+        std::cout << " (" << numChanged << " changed or new, " << numRemoved << " removed)";
+    }
+    std::cout << "." << std::endl;
+    return true;
+}
+
+
+void BackendServer::logReservation(uint32_t id) {
+    if (wal) {
+        std::lock_guard<std::mutex> guard(logLock);
+        wal->append(roomData.code(id), -1);
+    }
+}
+
+
+/**
+ * Write the reservations logged since the last call (group commit), and take a snapshot if the log is long enough
+ * @return whether successful or not
+ */
+bool BackendServer::commitLog() {
+    if (!wal) {
+        return true;
+    }
+    {
+        // records other workers appended meanwhile are written too, so their commit finds nothing left to do
+        std::lock_guard<std::mutex> guard(logLock);
+        if (!wal->commit()) {
+            return false;
+        }
+        if (wal->size() < snapshotRecords) {
+            return true;
+        }
+    }
+    return takeSnapshot();
+}
+
+
+/**
+ * Snapshot the room data, counting held rooms as available (their holds are not logged), and empty the log
+ * @return whether successful or not
+ */
+bool BackendServer::takeSnapshot() {
+    // no worker changes counts, holds or the log meanwhile
+    std::unique_lock<std::shared_mutex> tableGuard(tableLock);
+    std::lock_guard<std::mutex> holdGuard(holdLock);
+    std::lock_guard<std::mutex> logGuard(logLock);
+    return saveSnapshot();
+}
+
+
+/**
+ * Snapshot the room data and empty the log; call with tableLock held exclusively, and holdLock and logLock held
+ * @return whether successful or not
+ */
+bool BackendServer::saveSnapshot() {
+    if (!wal->commit()) {
+        return false;
+    }
+    std::vector<int> held;
+    if (!holds.empty()) {
+        held.resize(roomData.size());
+        for (const auto& hold : holds) {
+            for (uint32_t id : hold.second.roomIds) {
+                held[id]++;
+            }
+        }
+    }
+    // the log is only emptied once the snapshot is in place; until then, replay skips what the snapshot includes
+    if (!roomData.save(logPath + ".snap", wal->lastLsn(), held) || !wal->truncate()) {
+        return false;
+    }
+    std::cout << "The Server " << serverName << " took a snapshot of " << roomData.size() << " rooms." << std::endl;
+    return true;
+}
+
+
+/**
+ * Creat & bind a UDP socket
+ * @return whether successful or not
+ */
+bool BackendServer::bootup() {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET; // use IPv4
+    hints.ai_socktype = SOCK_DGRAM; // use UDP
+
+    struct addrinfo *serverInfo;
+
+    // Create a UDP socket and bind to the designated port
+    if (getaddrinfo(hostAddress.c_str(), port_UDP.c_str(), &hints, &serverInfo) != 0) {
+        perror(("Server" + serverName + ": getaddrinfo").c_str());
+        return false;
+    }
+    sockfd_UDP = socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol);
+    if (sockfd_UDP == -1) {
+        perror(("Server" + serverName + ": socket").c_str());
+        return false;
+    }
+    if (bind(sockfd_UDP, serverInfo->ai_addr, serverInfo->ai_addrlen) == -1) {
+        close(sockfd_UDP);
+        perror(("Server" + serverName + ": bind").c_str());
+        return false;
+    }
+    freeaddrinfo(serverInfo);
+    for (int i = 0; i < numWorkers; i++) { // every worker receives from the same socket, with its own buffers
+        batchers.emplace_back(new DatagramBatcher(sockfd_UDP, batchSize, MAX_DATAGRAM)); // batch requests can be long
+    }
+
+    std::cout << "The Server " << serverName << " is up and running using UDP on port " << port_UDP << "." << std::endl;
+
+    return true;
+}
+
+
+/**
+ * Stores main server information into SMinfo
+ * @param hostAddress host address of the main server
+ * @param UDPport the UDP port of the main server, over which the backend server communicate with the main server
+ * @return whether successful or not
+ */
+bool BackendServer::addMainServer(const std::string& hostAddress, const std::string& UDPport) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET; // use IPv4
+    hints.ai_socktype = SOCK_DGRAM; // use UDP
+
+    if (getaddrinfo(hostAddress.c_str(), UDPport.c_str(), &hints, &SMinfo) != 0) {
+        perror("ServerM: getaddrinfo");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Largest INIT datagram that fits the path MTU towards the main server, without IP fragmentation
+ * @return datagram size in bytes
+ */
+size_t BackendServer::initChunkSize() const {
+    size_t chunkSize = 1500 - 28; // Ethernet MTU minus IPv4 and UDP headers, if the path MTU is unknown
+    int sockfd = socket(SMinfo->ai_family, SOCK_DGRAM, 0);
+    int mtu;
+    socklen_t mtuLen = sizeof mtu;
+    if (sockfd != -1 && connect(sockfd, SMinfo->ai_addr, SMinfo->ai_addrlen) == 0 &&
+        getsockopt(sockfd, IPPROTO_IP, IP_MTU, &mtu, &mtuLen) == 0 && mtu > 576) {
+        chunkSize = mtu - 28;
+    }
+    if (sockfd != -1) {
+        close(sockfd);
+    }
+    return std::min<size_t>(chunkSize, MAX_DATAGRAM);
+}
+
+
+/**
+ * Send the room data to the main server as a stream of sequenced INIT chunks, each sized to the path MTU.
+ * Up to INIT_WINDOW chunks (and INIT_WINDOW_BYTES) are unacknowledged at a time; a chunk not acknowledged within INIT_RETRANSMIT_MS
+ * is sent again.
+ * @return whether successful or not; fails if the main server acknowledges nothing for INIT_MAX_RETRIES rounds
+ */
+bool BackendServer::sendInitDataToMainServer() {
+    auto start = std::chrono::steady_clock::now();
+    std::string transferId = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+
+    // split the entries into chunks; every chunk's header is "INIT\n(transferid)\n(seq)\n(total)\n"
+    size_t chunkSize = initChunkSize();
+    size_t budget = chunkSize - 64; // room for the header
+    size_t window = std::max<size_t>(1, std::min<size_t>(INIT_WINDOW, INIT_WINDOW_BYTES / chunkSize));
+    std::vector<std::string> chunks(1);
+    for (uint32_t id = 0; id < roomData.size(); id++) {
+        std::string entry = std::string(roomData.code(id)) + "," + std::to_string(roomData.count(id)) + "\n";
+        if (!chunks.back().empty() && chunks.back().length() + entry.length() > budget) {
+            chunks.emplace_back();
+        }
+        chunks.back() += entry;
+    }
+    if (chunks.size() > INIT_MAX_CHUNKS) {
+        std::cerr << "Server" << serverName << ": too many rooms to send to the main server" << std::endl;
+        return false;
+    }
+    std::string total = std::to_string(chunks.size());
+    for (size_t seq = 0; seq < chunks.size(); seq++) {
+        chunks[seq] = std::string(MSG_INIT) + "\n" + transferId + "\n" + std::to_string(seq) + "\n" + total + "\n" + chunks[seq];
+    }
+
+    std::vector<bool> acked(chunks.size(), false);
+    std::vector<std::chrono::steady_clock::time_point> sentAt(chunks.size());
+    size_t base = 0; // first chunk not acknowledged
+    size_t next = 0; // first chunk never sent
+    size_t numBytes = 0, numDatagrams = 0;
+    int retries = 0;
+    char buf[MAXBUFLEN];
+
+    while (base < chunks.size()) {
+        // fill the window
+        while (next < chunks.size() && next < base + window) {
+            if (sendto(sockfd_UDP, chunks[next].c_str(), chunks[next].length(), 0, SMinfo->ai_addr, SMinfo->ai_addrlen) == -1) {
+                perror(("Server" + serverName + ": sendto").c_str());
+                return false;
+            }
+            sentAt[next] = std::chrono::steady_clock::now();
+            numBytes += chunks[next].length();
+            numDatagrams++;
+            next++;
+        }
+
+        // wait for acknowledgements
+        struct pollfd pfd = {sockfd_UDP, POLLIN, 0};
+        int ready = poll(&pfd, 1, INIT_RETRANSMIT_MS);
+        if (ready == -1 && errno != EINTR) {
+            perror(("Server" + serverName + ": poll").c_str());
+            return false;
+        }
+        if (ready > 0) {
+            struct sockaddr_storage senderAddr; // keep SMinfo pointing at the main server's designated port
+            socklen_t addrLen = sizeof senderAddr;
+            int numbytes = recvfrom(sockfd_UDP, buf, MAXBUFLEN - 1, 0, (struct sockaddr *)&senderAddr, &addrLen);
+            if (numbytes <= 0) {
+                continue;
+            }
+            buf[numbytes] = '\0';
+            std::istringstream iss(buf);
+            std::string op, ackTransferId, seqStr;
+            getline(iss, op);
+            getline(iss, ackTransferId);
+            getline(iss, seqStr);
+            size_t seq = strtoul(seqStr.c_str(), nullptr, 10);
+            // anything else (a request from an early client) is dropped; the main server retransmits it
+            if (op == MSG_INIT_ACK && ackTransferId == transferId && seq < next && !acked[seq]) {
+                acked[seq] = true;
+                retries = 0;
+                while (base < chunks.size() && acked[base]) {
+                    base++;
+                }
+            }
+            continue;
+        }
+
+        // timed out: retransmit every chunk in the window waiting for longer than INIT_RETRANSMIT_MS
+        if (++retries > INIT_MAX_RETRIES) {
+            std::cout << "The Server " << serverName << " got no acknowledgement of the room status from the main server." << std::endl;
+            return false;
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (size_t seq = base; seq < next; seq++) {
+            if (!acked[seq] && now - sentAt[seq] >= std::chrono::milliseconds(INIT_RETRANSMIT_MS)) {
+                sendto(sockfd_UDP, chunks[seq].c_str(), chunks[seq].length(), 0, SMinfo->ai_addr, SMinfo->ai_addrlen);
+                sentAt[seq] = now;
+                numBytes += chunks[seq].length();
+                numDatagrams++;
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "The Server " << serverName << " has sent the room status to the main server." << std::endl;
+    std::cout << "(" << roomData.size() << " rooms in " << chunks.size() << " chunks, " << numDatagrams << " datagrams, "
+        << seconds * 1000 << " ms, " << numBytes / seconds / 1e6 << " MB/s)" << std::endl;
+    return true;
+}
+
+
+/**
+ * Push a changed room status to the main server, so its cache of all room data stays coherent.
+ * Message: "UPD\n(version)\n(roomcode),(num_available)"
+ * @param roomcode room layout code
+ * @param id ID of the room layout, or ROOM_NOT_FOUND if it has been removed
+ * @param addr address of the main server's socket the request came from
+ * @param addrLen length of addr
+ * @param batcher batcher of the worker to send with
+ */
+void BackendServer::pushUpdate(const std::string& roomcode, uint32_t id, const struct sockaddr *addr, socklen_t addrLen,
+                               DatagramBatcher& batcher) {
+    uint64_t version = ++updateVersion;
+    int numAvailable = id == ROOM_NOT_FOUND ? 0 : roomData.load(id);
+    std::string msg = std::string(MSG_UPDATE) + "\n" + std::to_string(version) + "\n" + roomcode + "," +
+        std::to_string(numAvailable);
+    if (!batcher.queue(msg, addr, addrLen)) {
+        perror(("Server" + serverName + ": sendmmsg").c_str());
+    }
+}
+
+
+/**
+ * @return steady clock time in microseconds, comparable between processes on the same host
+ */
+static long long steadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void BackendServer::replicate(uint32_t id, DatagramBatcher& batcher) {
+    if (replicaAddrs.empty()) {
+        return;
+    }
+    uint64_t version = ++replicationVersion;
+    // read after taking the version: whichever change takes the highest version reads the latest count
+    int numAvailable = roomData.load(id);
+    std::string msg = std::string(MSG_REPLICATE) + "\n" + std::to_string(version) + "\n" +
+        std::to_string(steadyMicros()) + "\n" + std::string(roomData.code(id)) + "," + std::to_string(numAvailable);
+    for (const auto& replicaAddr : replicaAddrs) {
+        if (!batcher.queue(msg, (const struct sockaddr *)&replicaAddr.first, replicaAddr.second)) {
+            perror(("Server" + serverName + ": sendmmsg").c_str());
+        }
+    }
+}
+
+
+void BackendServer::sendSyncChunks(size_t firstChunk, const struct sockaddr *addr, socklen_t addrLen,
+                                   DatagramBatcher& batcher) {
+    if (syncChunkStarts.empty()) { // not a primary with replicas
+        return;
+    }
+    size_t numChunks = syncChunkStarts.size() - 1;
+    // counts changed after this version are streamed with a later one, so the replica keeps the newer count
+    uint64_t version = replicationVersion.load();
+    for (size_t seq = firstChunk; seq < std::min(numChunks, firstChunk + INIT_WINDOW); seq++) {
+        std::string msg = std::string(MSG_SYNC_CHUNK) + "\n" + std::to_string(version) + "\n" + std::to_string(seq) +
+            "\n" + std::to_string(numChunks);
+        for (uint32_t id = syncChunkStarts[seq]; id < syncChunkStarts[seq + 1]; id++) {
+            msg += "\n" + std::string(roomData.code(id)) + "," + std::to_string(roomData.load(id));
+        }
+        if (!batcher.queue(msg, addr, addrLen)) {
+            perror(("Server" + serverName + ": sendmmsg").c_str());
+        }
+    }
+}
+
+
+/**
+ * Apply the count of a room layout from the primary, unless a newer one has been applied already; replica only,
+ * with replicaLock held
+ * @param state replication progress of the replica
+ * @param roomData room data of the replica
+ * @param line "(roomcode),(num_available)"
+ * @param version replication version of the count
+ */
+static void applyReplicatedCount(struct ReplicaState& state, RoomIndex& roomData, std::string_view line,
+                                 uint64_t version) {
+    std::string_view roomcode;
+    int numAvailable;
+    if (!scanRoomEntry(line, roomcode, numAvailable)) {
+        return;
+    }
+    uint32_t id = roomData.find(roomcode);
+    if (id != ROOM_NOT_FOUND && version >= state.roomVersions[id]) {
+        roomData.store(id, numAvailable);
+        state.roomVersions[id] = version;
+    }
+}
+
+
+/**
+ * Advance the version up to which every update has been applied, past the versions applied ahead of it
+ * @param state replication progress of the replica
+ */
+static void advanceApplied(struct ReplicaState& state) {
+    uint64_t before = state.applied;
+    while (!state.appliedAhead.empty() && *state.appliedAhead.begin() <= state.applied + 1) {
+        state.applied = std::max(state.applied, *state.appliedAhead.begin());
+        state.appliedAhead.erase(state.appliedAhead.begin());
+    }
+    if (state.applied != before) {
+        state.appliedAt = std::chrono::steady_clock::now();
+    }
+}
+
+
+void BackendServer::applyReplication(const std::string& op, std::istringstream& iss, DatagramBatcher& batcher) {
+    if (!isReplica()) {
+        return;
+    }
+    std::string line;
+    getline(iss, line);
+    uint64_t version = strtoull(line.c_str(), nullptr, 10);
+    std::lock_guard<std::mutex> guard(replicaLock);
+    struct ReplicaState& state = replica;
+
+    if (op == MSG_REPLICATE) {
+        getline(iss, line);
+        long long sentAt = strtoll(line.c_str(), nullptr, 10);
+        state.latest = std::max(state.latest, version);
+        if (!getline(iss, line)) { // the primary only announces its latest version
+            return;
+        }
+        applyReplicatedCount(state, roomData, line, version);
+        state.delayUs = steadyMicros() - sentAt;
+        if (version > state.applied) {
+            state.appliedAhead.insert(version);
+            advanceApplied(state);
+        }
+        return;
+    }
+
+    // MSG_SYNC_CHUNK
+    getline(iss, line);
+    size_t seq = strtoul(line.c_str(), nullptr, 10);
+    getline(iss, line);
+    size_t total = strtoul(line.c_str(), nullptr, 10);
+    if (state.synced || total == 0 || seq >= total) { // a late chunk of a finished sync
+        return;
+    }
+    if (state.chunksReceived.size() != total) { // the primary's room data differs from the chunks so far
+        state.chunksReceived.assign(total, false);
+        state.numChunksReceived = 0;
+        state.syncVersion = UINT64_MAX;
+    }
+    if (state.chunksReceived[seq]) {
+        return;
+    }
+    while (getline(iss, line)) {
+        applyReplicatedCount(state, roomData, line, version);
+    }
+    state.chunksReceived[seq] = true;
+    state.numChunksReceived++;
+    state.syncVersion = std::min(state.syncVersion, version);
+    state.latest = std::max(state.latest, version);
+
+    if (state.numChunksReceived == total) {
+        // every update up to the oldest chunk's version is older than the counts the chunks carry
+        state.synced = true;
+        state.applied = std::max(state.applied, state.syncVersion);
+        state.appliedAt = std::chrono::steady_clock::now();
+        advanceApplied(state);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - state.syncStart).count();
+        std::cout << "The Server " << serverName << " has synced the room data of " << roomData.size()
+            << " rooms from Server " << primaryName << "." << std::endl;
+        std::cout << "(" << total << " chunks, " << seconds * 1000 << " ms)" << std::endl;
+        return;
+    }
+    // ask for the next window as soon as the last one is complete
+    size_t windowEnd = std::min(total, state.syncRequestedFrom + INIT_WINDOW);
+    if (std::all_of(state.chunksReceived.begin() + state.syncRequestedFrom, state.chunksReceived.begin() + windowEnd,
+                    [](bool received) { return received; })) {
+        requestSync(batcher);
+    }
+}
+
+
+void BackendServer::requestSync(DatagramBatcher& batcher) {
+    struct ReplicaState& state = replica;
+    auto missing = std::find(state.chunksReceived.begin(), state.chunksReceived.end(), false);
+    state.syncRequestedFrom = missing - state.chunksReceived.begin(); // 0 before the first chunk
+    if (state.numChunksReceived == 0) {
+        state.syncStart = std::chrono::steady_clock::now();
+    }
+    state.nextSyncRequest = std::chrono::steady_clock::now() + std::chrono::milliseconds(SYNC_RETRY_MS);
+    std::string msg = std::string(MSG_SYNC) + "\n" + std::to_string(state.syncRequestedFrom);
+    if (!batcher.queue(msg, (const struct sockaddr *)&primaryAddr, primaryAddrLen)) {
+        perror(("Server" + serverName + ": sendmmsg").c_str());
+    }
+}
+
+
+void BackendServer::replicationTick(DatagramBatcher& batcher) {
+    if (replicaAddrs.empty() && !isReplica()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> guard(replicaLock);
+    if (now < nextReplicationTick) {
+        return;
+    }
+    nextReplicationTick = now + std::chrono::milliseconds(REPLICA_HEARTBEAT_MS);
+
+    if (!replicaAddrs.empty()) { // a primary announces its latest version, so replicas notice missed updates
+        std::string msg = std::string(MSG_REPLICATE) + "\n" + std::to_string(replicationVersion.load()) + "\n" +
+            std::to_string(steadyMicros());
+        for (const auto& replicaAddr : replicaAddrs) {
+            if (!batcher.queue(msg, (const struct sockaddr *)&replicaAddr.first, replicaAddr.second)) {
+                perror(("Server" + serverName + ": sendmmsg").c_str());
+            }
+        }
+        return;
+    }
+
+    struct ReplicaState& state = replica;
+    if (state.synced && state.latest > state.applied &&
+        now - state.appliedAt >= std::chrono::milliseconds(REPLICA_RESYNC_MS)) {
+        std::cout << "The Server " << serverName << " missed updates from Server " << primaryName
+            << "; syncing the room data again." << std::endl;
+        state.synced = false;
+        state.chunksReceived.clear();
+        state.numChunksReceived = 0;
+        state.syncVersion = UINT64_MAX;
+        state.nextSyncRequest = now;
+    }
+    if (!state.synced && now >= state.nextSyncRequest) {
+        requestSync(batcher);
+    }
+    if (now >= state.nextReport) {
+        state.nextReport = now + std::chrono::milliseconds(REPLICA_REPORT_MS);
+        long behind = state.latest - state.applied;
+        std::string msg = std::string(MSG_REPLICA_LAG) + "\n" + std::to_string(behind) + "\n" +
+            std::to_string(state.delayUs) + "\n" + (state.synced ? "1" : "0");
+        if (!batcher.queue(msg, SMinfo->ai_addr, SMinfo->ai_addrlen)) {
+            perror(("Server" + serverName + ": sendmmsg").c_str());
+        }
+        if (state.synced && behind != state.lastReportedBehind) {
+            std::cout << "The Server " << serverName << " is " << behind << " updates behind Server " << primaryName
+                << "; the last update took " << state.delayUs << " us." << std::endl;
+            state.lastReportedBehind = behind;
+        }
+    }
+}
+
+
+void BackendServer::setBatching(size_t batchSize, long flushLatencyUs) {
+    this->batchSize = std::max<size_t>(1, batchSize);
+    this->flushLatencyUs = std::max(0L, flushLatencyUs);
+}
+
+
+void BackendServer::setWorkers(int numWorkers) {
+    this->numWorkers = std::max(1, numWorkers);
+}
+
+
+/**
+ * Run the worker threads, each receiving requests from the shared UDP socket; the calling thread is worker 0.
+ * The room data is reloaded whenever the process gets RELOAD_SIGNAL.
+ * Never returns.
+ */
+void BackendServer::run() {
+    onReloadSignal([this]() { reloadData(); });
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numWorkers; i++) {
+        threads.emplace_back([this, i]() {
+            while (true) {
+                handleMainServer(i);
+            }
+        });
+    }
+    while (true) {
+        handleMainServer(0);
+    }
+}
+
+
+/**
+  * Receive a batch of requests from the main server over the UDP port, and react accordingly.
+  * Replies are sent together once no more requests arrive within the flush latency, or the batch is full.
+  * @param worker index of the calling worker thread
+  */
+void BackendServer::handleMainServer(int worker) {
+    DatagramBatcher& batcher = *batchers[worker];
+    // wake up in time to release expired holds, to sync the log and for periodic replication work
+    bool wakeUpDue = false;
+    auto wakeUp = std::chrono::steady_clock::time_point::max();
+    if (!replicaAddrs.empty() || isReplica()) {
+        std::lock_guard<std::mutex> guard(replicaLock);
+        wakeUp = nextReplicationTick;
+        wakeUpDue = true;
+    }
+    {
+        std::lock_guard<std::mutex> guard(holdLock);
+        if (!holdExpiry.empty()) {
+            wakeUp = std::min(wakeUp, holdExpiry.front().first);
+            wakeUpDue = true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(logLock);
+        if (wal && wal->syncPending()) {
+            wakeUp = std::min(wakeUp, wal->syncDeadline());
+            wakeUpDue = true;
+        }
+    }
+    if (wakeUpDue) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = {sockfd_UDP, POLLIN, 0};
+        if (poll(&pfd, 1, std::max<long long>(0, wait + 1)) == 0) {
+            {
+                std::shared_lock<std::shared_mutex> tableGuard(tableLock);
+                expireHolds(batcher);
+            }
+            replicationTick(batcher);
+            if (!commitLog()) {
+                exit(1);
+            }
+            if (!batcher.flush()) {
+                perror(("Server" + serverName + ": sendmmsg").c_str());
+                exit(1);
+            }
+            return;
+        }
+    }
+    // block for the first request only, unless a deadline is due: another worker sharing the socket may have
+    // taken the request poll() saw, so go back to the deadlines instead of blocking past them
+    int numReceived = batcher.receive(wakeUpDue ? MSG_DONTWAIT : MSG_WAITFORONE);
+    if (numReceived == 0) {
+        return;
+    }
+    auto flushBy = std::chrono::steady_clock::now() + std::chrono::microseconds(flushLatencyUs);
+    bool first = true;
+    while (true) {
+        if (numReceived == -1 && errno != EINTR && errno != EAGAIN) {
+            perror("recvmmsg");
+            exit(1);
+        }
+        {
+            // a snapshot waits until no worker is in the middle of changing counts, holds and the log
+            std::shared_lock<std::shared_mutex> tableGuard(tableLock);
+            if (first) {
+                expireHolds(batcher);
+                first = false;
+            }
+            for (int i = 0; i < numReceived; i++) {
+                handleRequest(std::string(batcher.datagram(i)), (const struct sockaddr *)&batcher.sender(i),
+                              batcher.senderLen(i), batcher);
+            }
+        }
+        if (batcher.reportDue()) {
+            std::cout << "The Server " << serverName << " UDP batching: " << batcher.statsStr() << std::endl;
+        }
+
+        // wait up to the flush latency for more requests to fill the batch of replies
+        auto now = std::chrono::steady_clock::now();
+        if (batcher.numQueued() == 0 || now >= flushBy) {
+            break;
+        }
+        long waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(flushBy - now).count();
+        struct timespec timeout = {waitNs / 1000000000, waitNs % 1000000000};
+        struct pollfd pfd = {sockfd_UDP, POLLIN, 0};
+        if (ppoll(&pfd, 1, &timeout, nullptr) <= 0) {
+            break;
+        }
+        numReceived = batcher.receive(MSG_DONTWAIT); // another worker may have taken the requests
+    }
+    replicationTick(batcher);
+    // one write (and fdatasync) covers every reservation of the batch, before any of its replies is sent
+    if (!commitLog()) {
+        exit(1);
+    }
+    if (!batcher.flush()) {
+        perror(("Server" + serverName + ": sendmmsg").c_str());
+        exit(1);
+    }
+}
+
+
+/**
+ * Check the availability of one room layout, without taking any lock
+ * @param roomcode room layout code
+ * @param id to store the ID of the room layout, or ROOM_NOT_FOUND
+ * @return result op code: MSG_CHECK_AVAILABLE, MSG_CHECK_UNAVAILABLE or MSG_CHECK_NOTFOUND
+ */
+std::string BackendServer::checkRoom(const std::string& roomcode, uint32_t& id) {
+    id = roomData.find(roomcode);
+    if (id == ROOM_NOT_FOUND) {
+        std::cout << "Not able to find the room layout." << std::endl;
+        return MSG_CHECK_NOTFOUND;
+    }
+    if (roomData.load(id) > 0) {
+        std::cout << "Room " << roomcode << " is available." << std::endl;
+        return MSG_CHECK_AVAILABLE;
+    }
+    std::cout << "Room " << roomcode << " is not available." << std::endl;
+    return MSG_CHECK_UNAVAILABLE;
+}
+
+
+/**
+ * Reserve one room of a room layout with a lock-free decrement-if-positive
+ * @param roomcode room layout code
+ * @param id to store the ID of the room layout, or ROOM_NOT_FOUND
+ * @return result op code: MSG_RESERVE_SUCCEED, MSG_RESERVE_FAIL or MSG_RESERVE_NOTFOUND
+ */
+std::string BackendServer::reserveRoom(const std::string& roomcode, uint32_t& id) {
+    id = roomData.find(roomcode);
+    if (id == ROOM_NOT_FOUND) {
+        std::cout << "Cannot make a reservation. Not able to find the room layout." << std::endl;
+        return MSG_RESERVE_NOTFOUND;
+    }
+    int numAvailable = roomData.takeOne(id);
+    if (numAvailable < 0) {
+        std::cout << "Cannot make a reservation. Room " << roomcode << " is not available." << std::endl;
+        return MSG_RESERVE_FAIL;
+    }
+    std::cout << "Successful reservation. The count of Room " << roomcode << " is now " << numAvailable << "." << std::endl;
+    return MSG_RESERVE_SUCCEED;
+}
+
+
+/**
+ * Prepare a group reservation: hold one room of each room layout until the main server commits or aborts.
+ * If any room cannot be held, none is.
+ * @param txid transaction ID
+ * @param roomcodes room layout codes
+ * @param addr address of the main server's socket the request came from
+ * @param addrLen length of addr
+ * @return one "(result op code),(num_available)" line per room layout, num_available being -1 for unknown ones
+ */
+std::string BackendServer::prepareHold(const std::string& txid, const std::vector<std::string>& roomcodes,
+                                       const struct sockaddr *addr, socklen_t addrLen) {
+    struct RoomHold hold;
+    std::vector<std::string> results;
+    bool held = true;
+    uint32_t id;
+    for (const std::string& roomcode : roomcodes) {
+        results.push_back(reserveRoom(roomcode, id));
+        if (results.back() == MSG_RESERVE_SUCCEED) {
+            hold.roomIds.push_back(id);
+        } else {
+            held = false;
+        }
+    }
+    if (held) {
+        hold.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HOLD_LEASE_MS);
+        memcpy(&hold.addr, addr, std::min<size_t>(addrLen, sizeof hold.addr));
+        hold.addrLen = addrLen;
+        {
+            std::lock_guard<std::mutex> guard(holdLock);
+            holds[txid] = hold;
+            holdExpiry.emplace_back(hold.deadline, txid);
+        }
+        std::cout << "The Server " << serverName << " holds " << roomcodes.size() << " rooms until the reservation is committed." << std::endl;
+    } else {
+        for (uint32_t heldId : hold.roomIds) {
+            roomData.giveOne(heldId);
+        }
+        std::cout << "The Server " << serverName << " released the rooms: not all of them are available." << std::endl;
+    }
+
+    std::string lines;
+    for (size_t i = 0; i < roomcodes.size(); i++) {
+        id = roomData.find(roomcodes[i]);
+        lines += "\n" + results[i] + "," + std::to_string(id == ROOM_NOT_FOUND ? -1 : roomData.load(id));
+    }
+    return lines;
+}
+
+
+/**
+ * Give the rooms of a hold back and push their counts to the main server
+ * @param txid transaction ID of the hold
+ * @param batcher batcher of the worker to send with
+ */
+void BackendServer::releaseHold(const std::string& txid, DatagramBatcher& batcher) {
+    struct RoomHold hold;
+    {
+        std::lock_guard<std::mutex> guard(holdLock);
+        auto it = holds.find(txid);
+        if (it == holds.end()) {
+            return;
+        }
+        hold = std::move(it->second);
+        holds.erase(it);
+    }
+    for (uint32_t id : hold.roomIds) {
+        roomData.giveOne(id);
+        pushUpdate(std::string(roomData.code(id)), id, (const struct sockaddr *)&hold.addr, hold.addrLen, batcher);
+        replicate(id, batcher);
+    }
+}
+
+
+/**
+ * Release the holds whose lease has expired
+ * @param batcher batcher of the worker to send with
+ */
+void BackendServer::expireHolds(DatagramBatcher& batcher) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::string> expired;
+    {
+        std::lock_guard<std::mutex> guard(holdLock);
+        while (!holdExpiry.empty() && holdExpiry.front().first <= now) {
+            auto it = holds.find(holdExpiry.front().second);
+            if (it != holds.end() && it->second.deadline <= now) { // not committed or aborted
+                std::cout << "The Server " << serverName << " released " << it->second.roomIds.size()
+                    << " held rooms: the reservation was neither committed nor aborted in time." << std::endl;
+                expired.push_back(holdExpiry.front().second);
+            }
+            holdExpiry.pop_front();
+        }
+    }
+    for (const std::string& txid : expired) {
+        releaseHold(txid, batcher);
+    }
+}
+
+
+/**
+ * Handle one request of the main server, and queue the reply
+ * @param msg the request
+ * @param addr address of the main server's socket the request came from
+ * @param addrLen length of addr
+ * @param batcher batcher of the worker to reply with
+ */
+void BackendServer::handleRequest(const std::string& msg, const struct sockaddr *addr, socklen_t addrLen,
+                                  DatagramBatcher& batcher) {
+    std::string op, requestId, roomcode, replyMsg;
+    std::vector<std::string> updatedRoomcodes; // room layouts whose count changed
+    std::string abortedTxid; // the hold to release
+    uint32_t id;
+
+    std::istringstream iss(msg);
+#ifdef DEBUG
+    std::cout << "Received message from the main server: " << iss.str() << std::endl;
+#endif
+    getline(iss, op); // extract operation code from the 1st line
+    if (op == MSG_REPLICATE || op == MSG_SYNC_CHUNK) { // from the primary of this replica
+        applyReplication(op, iss, batcher);
+        return;
+    }
+    getline(iss, requestId); // extract the request ID from the 2nd line
+    if (op == MSG_SYNC) { // from a replica of this primary, the 2nd line being the first chunk it is missing
+        sendSyncChunks(strtoul(requestId.c_str(), nullptr, 10), addr, addrLen, batcher);
+        return;
+    }
+    getline(iss, roomcode); // extract roomcode from the 3rd line
+    if (isReplica() && op != MSG_CHECK_REQUEST && op != MSG_CHECK_BATCH) {
+        std::cout << "The Server " << serverName << " is a replica and does not take reservations." << std::endl;
+        return;
+    }
+    if (op != MSG_CHECK_REQUEST && op != MSG_RESERVE_REQUEST && op != MSG_CHECK_BATCH && op != MSG_RESERVE_BATCH &&
+        op != MSG_PREPARE && op != MSG_COMMIT && op != MSG_ABORT) { // e.g. a late INIT acknowledgement
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(recentLock);
+        auto recent = recentReplies.find(requestId);
+        if (recent != recentReplies.end()) {
+            // a retransmitted request: resend the same reply instead of, e.g., reserving the room twice.
+            // If another worker is still handling the request, drop the copy; the main server retransmits again.
+            if (!recent->second.empty() && !batcher.queue(recent->second, addr, addrLen)) {
+                perror(("Server" + serverName + ": sendmmsg").c_str());
+                exit(1);
+            }
+#ifdef DEBUG
+            std::cout << "Resent the response to request " << requestId << std::endl;
+#endif
+            return;
+        }
+        // claim the request ID, so a retransmission reaching another worker is not handled twice
+        recentReplies[requestId] = "";
+        recentRequestIds.push_back(requestId);
+        if (recentRequestIds.size() > RECENT_REPLIES) {
+            recentReplies.erase(recentRequestIds.front());
+            recentRequestIds.pop_front();
+        }
+    }
+
+    if (op == MSG_CHECK_REQUEST) {
+        std::cout << "The Server " << serverName << " received an availability request from the main server." << std::endl;
+        replyMsg = checkRoom(roomcode, id) + "\n" + requestId;
+    }
+    else if (op == MSG_RESERVE_REQUEST) {
+        std::cout << "The Server " << serverName << " received a reservation request from the main server." << std::endl;
+        replyMsg = reserveRoom(roomcode, id);
+        if (replyMsg == MSG_RESERVE_SUCCEED) {
+            logReservation(id);
+            updatedRoomcodes.push_back(roomcode);
+            // the update version is read before the count, like in pushUpdate(), so the main server can order them
+            std::string version = std::to_string(updateVersion.load());
+            replyMsg += "\n" + requestId + "\n" + version + "\n" + roomcode + "," + std::to_string(roomData.load(id));
+        }
+        else {
+            replyMsg += "\n" + requestId;
+        }
+    }
+    else if (op == MSG_CHECK_BATCH || op == MSG_RESERVE_BATCH) {
+        // one roomcode per line from the 3rd line on; the update version, then one "(result op code),(num_available)"
+        // line per roomcode, num_available being -1 for unknown room layouts
+        bool check = op == MSG_CHECK_BATCH;
+        std::vector<std::string> roomcodes;
+        for (bool more = !roomcode.empty(); more; more = (bool)getline(iss, roomcode)) {
+            roomcodes.push_back(roomcode);
+        }
+        std::cout << "The Server " << serverName << " received a batch " << (check ? "availability" : "reservation")
+            << " request on " << roomcodes.size() << " rooms from the main server." << std::endl;
+        replyMsg = check ? MSG_CHECK_BATCH_RESULT : MSG_RESERVE_BATCH_RESULT;
+        replyMsg += "\n" + requestId + "\n" + std::to_string(updateVersion.load());
+        for (const std::string& batchRoomcode : roomcodes) {
+            std::string result = check ? checkRoom(batchRoomcode, id) : reserveRoom(batchRoomcode, id);
+            if (result == MSG_RESERVE_SUCCEED) {
+                logReservation(id);
+                updatedRoomcodes.push_back(batchRoomcode);
+            }
+            replyMsg += "\n" + result + "," + std::to_string(id == ROOM_NOT_FOUND ? -1 : roomData.load(id));
+        }
+    }
+    else if (op == MSG_PREPARE) {
+        // the 3rd line is the transaction ID, followed by one roomcode per line
+        std::string txid = roomcode;
+        std::vector<std::string> roomcodes;
+        while (getline(iss, roomcode)) {
+            roomcodes.push_back(roomcode);
+        }
+        std::cout << "The Server " << serverName << " received a group reservation request on " << roomcodes.size()
+            << " rooms from the main server." << std::endl;
+        std::string version = std::to_string(updateVersion.load());
+        replyMsg = std::string(MSG_PREPARE_RESULT) + "\n" + requestId + "\n" + version +
+            prepareHold(txid, roomcodes, addr, addrLen);
+        for (const std::string& heldRoomcode : roomcodes) { // held rooms are taken, as far as replicas are concerned
+            if ((id = roomData.find(heldRoomcode)) != ROOM_NOT_FOUND) {
+                replicate(id, batcher);
+            }
+        }
+    }
+    else if (op == MSG_COMMIT) {
+        std::lock_guard<std::mutex> guard(holdLock);
+        auto hold = holds.find(roomcode); // the 3rd line is the transaction ID
+        if (hold != holds.end()) {
+            std::cout << "The Server " << serverName << " committed the reservation of " << hold->second.roomIds.size()
+                << " rooms." << std::endl;
+            for (uint32_t heldId : hold->second.roomIds) { // only now the rooms are reserved for good
+                logReservation(heldId);
+            }
+            holds.erase(hold);
+            replyMsg = MSG_COMMIT_OK;
+        } else {
+            std::cout << "The Server " << serverName << " cannot commit the reservation: its rooms are no longer held." << std::endl;
+            replyMsg = MSG_COMMIT_EXPIRED;
+        }
+        replyMsg += "\n" + requestId;
+    }
+    else { // MSG_ABORT
+        {
+            std::lock_guard<std::mutex> guard(holdLock);
+            if (holds.find(roomcode) != holds.end()) {
+                std::cout << "The Server " << serverName << " aborted the reservation." << std::endl;
+            }
+        }
+        abortedTxid = roomcode;
+        replyMsg = MSG_ABORT_OK;
+        replyMsg += "\n" + requestId;
+    }
+    {
+        // remember the reply in case the request is retransmitted
+        std::lock_guard<std::mutex> guard(recentLock);
+        auto recent = recentReplies.find(requestId);
+        if (recent != recentReplies.end()) {
+            recent->second = replyMsg;
+        }
+    }
+
     // send response to Server M
-    if (sendto(sockfd_UDP, replyMsg.c_str(), replyMsg.length(), 0, SMinfo->ai_addr, SMinfo->ai_addrlen) == -1) {
-        perror(("Server" + serverName + ": sendto").c_str());
+    if (!batcher.queue(replyMsg, addr, addrLen)) {
+        perror(("Server" + serverName + ": sendmmsg").c_str());
         exit(1);
     }
+    for (const std::string& updated : updatedRoomcodes) { // after the reply, so the main server sees them in this order
+        pushUpdate(updated, roomData.find(updated), addr, addrLen, batcher);
+        replicate(roomData.find(updated), batcher);
+    }
+    if (!abortedTxid.empty()) {
+        releaseHold(abortedTxid, batcher);
+    }
     std::cout << "The Server " << serverName << " finished sending the response to the main server." << std::endl;
 }
+
+
+/**
+ * Start a backend server of a building type: read its command line options, look it up in the backends
+ * configuration file, load its room data, send it to the main server and serve requests; serverS, serverD and
+ * serverU are this with their building type and input file
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @param buildingType building type the server must serve, e.g. 'S'; also its default name
+ * @param inputFile text room inventory of the building type, e.g. "single.txt"
+ * @return exit status if the server could not start; never returns otherwise
+ */
+int runBackendMain(int argc, char *argv[], char buildingType, const std::string& inputFile) {
+    // -B: max datagrams per recvmmsg/sendmmsg call, -L: max microseconds a reply waits for its batch to fill,
+    // -l: keep room counts across restarts in a write-ahead log and snapshots,
+    // -F: max milliseconds logged reservations wait for fdatasync (0: before each batch of replies, -1: never),
+    // -S: log records after which to take a snapshot, -t: number of worker threads,
+    // -n: name of this backend server in the backends configuration file (default: the building type), -b: that file
+    size_t batchSize = UDP_BATCH_SIZE;
+    long flushLatencyUs = UDP_FLUSH_LATENCY_US;
+    bool durable = false;
+    long fsyncIntervalMs = WAL_FSYNC_INTERVAL_MS;
+    long snapshotRecords = SNAPSHOT_RECORDS;
+    int numWorkers = BACKEND_WORKERS;
+    std::string name(1, buildingType);
+    std::string backendsConf = BACKENDS_CONF;
+    int opt;
+    while ((opt = getopt(argc, argv, "B:L:lF:S:t:n:b:")) != -1) {
+        if (opt == 'B' && atoi(optarg) > 0) {
+            batchSize = atoi(optarg);
+        }
+        else if (opt == 'L' && atol(optarg) >= 0) {
+            flushLatencyUs = atol(optarg);
+        }
+        else if (opt == 'l') {
+            durable = true;
+        }
+        else if (opt == 'F') {
+            fsyncIntervalMs = atol(optarg);
+        }
+        else if (opt == 'S' && atol(optarg) > 0) {
+            snapshotRecords = atol(optarg);
+        }
+        else if (opt == 't' && atoi(optarg) > 0) {
+            numWorkers = atoi(optarg);
+        }
+        else if (opt == 'n') {
+            name = optarg;
+        }
+        else if (opt == 'b') {
+            backendsConf = optarg;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [-B batch_size] [-L flush_latency_us] [-l] [-F fsync_interval_ms]"
+                " [-S snapshot_records] [-t threads] [-n name] [-b backends_conf]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Look up this backend server's address and the other shards of its building type
+    ShardMap shards;
+    if (!shards.load(backendsConf)) {
+        return 1;
+    }
+    const BackendShard *shard = shards.find(name);
+    if (shard == nullptr || shard->buildingType != buildingType) {
+        std::cerr << "Server " << buildingType << ": no backend server " << name << " of building type " << buildingType
+            << " in " << backendsConf << std::endl;
+        return 1;
+    }
+
+    // Create a BackendServer with a given name, a host address and a UDP port number.
+    BackendServer server(shard->name, shard->hostAddress, shard->port);
+    if (!server.setShards(shards)) {
+        return 1;
+    }
+    server.setBatching(batchSize, flushLatencyUs);
+    server.setWorkers(numWorkers);
+    if (durable && !server.isReplica()) { // a replica gets its room data from its primary
+        server.enableLog("server" + shard->name, fsyncIntervalMs, snapshotRecords);
+    }
+
+    // Initialize room data from the snapshot and log, or from input file
+    if (!server.loadData(inputFile)) {
+        return 1;
+    }
+
+    // Bootup: create and bind a UDP socket
+    if (!server.bootup()) {
+        return 1;
+    }
+    // Add main server address & UDP port info
+    server.addMainServer(LOCAL_HOST, PORT_SM_UDP);
+    // Send initial roomData to Server M; a replica fetches the primary's room data once it runs instead.
+    if (!server.isReplica() && !server.sendInitDataToMainServer()) {
+        return 1;
+    }
+
+    // Main loop: worker threads receive from Server M, send replies to Server M.
+    server.run();
+    return 0;
+}
@@ -16,11 +16,35 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <map>
-#include <regex>
+#include <climits>
 #include <sys/wait.h>
 #include <signal.h>
 #include <set>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <string_view>
+#include "binary_protocol.h"
+#include "room_index.h"
+#include "room_log.h"
+#include "shard_map.h"
+#include "member_index.h"
+#include "offset_cipher.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <functional>
+#include <sys/random.h>
 
 
 
@@ -32,11 +56,47 @@
 #define PORT_SM_UDP "44902"
 #define PORT_SM_TCP "45902"
 #define MAXBUFLEN 1024
+#define MAX_DATAGRAM 65507 // largest UDP payload over IPv4
 #define BACKLOG 10
+#define MAX_EVENTS 64 // max number of events returned by one epoll_wait()
+#define REQUEST_TIMEOUT_MS 500 // how long the main server waits for a backend reply before retransmitting
+#define MAX_RETRANSMITS 3 // retransmissions of one backend request before giving up
+#define MAX_PENDING_INPUT 65536 // max bytes of incomplete messages buffered per client connection
+#define LOAD_CHUNK_MIN_BYTES (1 << 20) // input files are scanned in parallel chunks of at least this size
+#define INIT_WINDOW 32 // INIT chunks a backend server sends ahead of the main server's acknowledgements
+#define INIT_WINDOW_BYTES 131072 // and at most this many bytes of them, to stay within the main server's socket buffer
+#define INIT_RETRANSMIT_MS 200 // how long a backend server waits for an INIT acknowledgement before retransmitting
+#define INIT_MAX_CHUNKS 1048576 // most INIT chunks of one transfer the main server accepts (about 100 million rooms)
+#define INIT_MAX_RETRIES 50 // retransmission rounds without any acknowledgement before a backend server gives up
+#define RECENT_REPLIES 4096 // replies a backend server remembers for answering retransmitted requests
+#define UDP_BATCH_SIZE 32 // default max datagrams per recvmmsg/sendmmsg call
+#define UDP_FLUSH_LATENCY_US 0 // default max time a datagram waits for its batch to fill before it is sent
+#define UDP_REPORT_INTERVAL 10000 // servers print their UDP batching counters every this many received datagrams
+#define MAX_BATCH_ROOMS 64 // max room layouts in one CHB/REB request
+// how long a backend server holds the rooms of a prepared group reservation; far longer than the main server takes
+// to decide (at most (MAX_RETRANSMITS + 1) * REQUEST_TIMEOUT_MS of prepares), so a commit retransmitted all along
+// reaches it while the rooms are still held
+#define HOLD_LEASE_MS 30000
+#define CACHE_REPORT_INTERVAL 1000 // the main server prints its cache counters every this many cached lookups
+#define WAL_FSYNC_INTERVAL_MS 0 // default max time logged reservations wait for fdatasync; 0: before each batch of replies
+#define BACKEND_WORKERS 1 // default number of worker threads of a backend server
+#define MAX_REACTORS 256 // most reactor threads of the main server: request IDs have 8 bits for the reactor
+#define SNAPSHOT_RECORDS 1000000 // default number of log records after which a backend server snapshots its room data
+#define REPLICA_HEARTBEAT_MS 200 // how often a primary backend server announces its latest update to its replicas
+#define REPLICA_REPORT_MS 1000 // how often a replica reports its replication lag to the main server
+#define REPLICA_MAX_LAG 100 // the main server sends availability checks only to replicas at most this many updates behind
+#define REPLICA_RESYNC_MS 1000 // a replica missing an update for this long fetches the whole room data again
+#define SYNC_CHUNK_BYTES 1400 // max bytes of room data entries in one chunk of a replica's sync
+#define SYNC_RETRY_MS 200 // how long a replica waits for the sync chunks it asked for before asking again
+#define SESSION_TOKEN_BYTES 16 // random bytes of a login session token, sent as twice as many hex digits
+#define SESSION_TTL_MS 1800000 // how long a login session can be resumed after its login or its last resume
+#define RELOAD_SIGNAL SIGHUP // makes servers read their input files again (member.txt, or their room inventory)
 
 
 // exchange messages' command/option
 #define MSG_INIT "INIT"
+#define MSG_INIT_ACK "INIT_ACK"
+#define MSG_UPDATE "UPD"
 #define MSG_CHECK_REQUEST "CH"
 #define MSG_CHECK_UNAVAILABLE "CH_0"
 #define MSG_CHECK_AVAILABLE "CH_1"
@@ -46,6 +106,8 @@
 #define MSG_RESERVE_SUCCEED "RE_1"
 #define MSG_RESERVE_NOTFOUND "RE_2"
 #define MSG_RESERVE_DENIED "RE_3"
+#define MSG_RESERVE_ABORTED "RE_4"
+#define MSG_RESERVE_UNCOMMITTED "RE_5"
 #define MSG_LOGIN_REQUEST "LI"
 #define MSG_LOGIN_FAIL "LI_0"
 #define MSG_LOGIN_MEMBER "LI_1"
@@ -53,10 +115,75 @@
 #define MSG_LOGIN_NOTFOUND "LI_3"
 #define MSG_LOGIN_INVALID_USERNAME "LI_4"
 #define MSG_LOGIN_INVALID_PASSWORD "LI_5"
+#define MSG_LOGIN_EXPIRED "LI_6"
+#define MSG_SESSION_TOKEN "LT"
+#define MSG_RESUME_REQUEST "LR"
+#define MSG_REQUEST_TIMEOUT "TO"
+#define MSG_CHECK_BATCH "CHB"
+#define MSG_CHECK_BATCH_RESULT "CHB_R"
+#define MSG_RESERVE_BATCH "REB"
+#define MSG_RESERVE_BATCH_RESULT "REB_R"
+#define MSG_PREPARE "PRE"
+#define MSG_PREPARE_RESULT "PRE_R"
+#define MSG_COMMIT "COM"
+#define MSG_COMMIT_OK "COM_1"
+#define MSG_COMMIT_EXPIRED "COM_0"
+#define MSG_ABORT "ABO"
+#define MSG_ABORT_OK "ABO_1"
+#define MSG_REPLICATE "REP"
+#define MSG_SYNC "SYNC"
+#define MSG_SYNC_CHUNK "SYNC_R"
+#define MSG_REPLICA_LAG "LAG"
 
 
 
 
+/**
+ * Split "username,password" like regex_search with "([^,]*),(.*)"
+ * @param line input string
+ * @param username to store the part before the first comma
+ * @param password to store the part after it, up to the first line terminator
+ * @return whether the line matches
+ */
+bool scanLoginInfo(std::string_view line, std::string_view& username, std::string_view& password);
+
+
+/**
+ * Split "roomcode, available number" like regex_search with "([^,]+),\s*(\d+)"
+ * @param line input string
+ * @param roomcode to store the roomcode
+ * @param numAvailable to store the available number
+ * @return whether the line matches; numbers that do not fit in an int are rejected
+ */
+bool scanRoomEntry(std::string_view line, std::string_view& roomcode, int& numAvailable);
+
+
+/**
+ * Split a member file line like regex_search with "([^,]{5,50}),\s(.{5,50})"
+ * @param line input string
+ * @param username to store the (at most 50) characters before the comma
+ * @param password to store the (at most 50) characters after the comma and one whitespace
+ * @return whether the line matches
+ */
+bool scanMemberEntry(std::string_view line, std::string_view& username, std::string_view& password);
+
+
+/**
+ * Check a username like regex_match with "[a-z]{5,50}"
+ * @param username (encrypted) username
+ * @return whether valid
+ */
+bool isValidUsername(std::string_view username);
+
+
+/**
+ * Check a password like regex_match with ".{5,50}"
+ * @param password (encrypted) password
+ * @return whether valid
+ */
+bool isValidPassword(std::string_view password);
+
+
 /**
  * Read from input string of log in information (form: "username,password"),
  * get username and password
@@ -95,28 +222,260 @@ std::string dataToStr(std::map<std::string, int> const& mymap);
 
 
 /**
- * Get the name of the server from the address & port
- * @param address IP address
- * @param port port number
- * @return A string representing the server's name
+ * Number of lines following the op code line in a message over TCP between a client and the main server
+ * @param op op code
+ * @return number of lines
+ */
+int numFieldsOf(const std::string& op);
+
+
+/**
+ * Take one complete message out of a TCP stream buffer. Every line of a message over TCP ends with "\n",
+ * and the number of lines following the op code line is fixed by the op code (see numFieldsOf).
+ * @param buf receive buffer
+ * @param pos offset of the first unparsed byte; moved past the message if it is complete
+ * @param fields to store the op code and the lines following it
+ * @return whether a complete message was taken
  */
-std::string portToServerName(const std::string& address, const std::string& port);
+bool takeMessage(const std::string& buf, size_t& pos, std::vector<std::string>& fields);
 
 
 // get sockaddr, IPv4 or IPv6; reused code from Beej's Guide 6.3
 void *get_in_addr(struct sockaddr *sa);
 
 
+/**
+ * Put a socket into non-blocking mode
+ * @param fd socket file descripter
+ * @return whether successful or not
+ */
+bool setNonBlocking(int fd);
+
+
+/**
+ * Block RELOAD_SIGNAL in the calling thread and in the threads it starts from then on, so it is only taken by
+ * the thread onReloadSignal() starts; call before starting any other thread
+ */
+void blockReloadSignal();
+
+
+/**
+ * Start a thread that calls a function every time the process gets RELOAD_SIGNAL; signals that arrive while the
+ * function runs are merged into one more call
+ * @param reload the function
+ */
+void onReloadSignal(std::function<void()> reload);
+
+
+/**
+ * Path of the room table file converted from a text room inventory: its extension replaced by ".rtab"
+ * @param file text input file path + name, e.g. "single.txt"
+ * @return room table file path, e.g. "single.rtab"
+ */
+std::string tableFileOf(const std::string& file);
+
+
+/**
+ * Read a text room inventory ("roomcode, available number" lines) into a room table.
+ * The file is memory-mapped and split at line boundaries into chunks that are scanned in parallel.
+ * @param file input file path + name
+ * @param rooms room table to add the entries to
+ * @return whether successful or not
+ */
+bool loadRoomFile(const std::string& file, RoomIndex& rooms);
+
+
+/**
+ * Batched UDP I/O on one socket: receives up to a batch of datagrams with one recvmmsg call, and queues outgoing
+ * datagrams until flushed with one sendmmsg call (or the batch is full). Counts datagrams and syscalls each way.
+ */
+class DatagramBatcher {
+private:
+    int sockfd;
+    size_t batchSize;
+    size_t maxDatagram; // capacity of one receive slot
+
+    std::vector<char> recvBuf; // batchSize slots of maxDatagram + 1 bytes, each datagram is '\0'-terminated
+    std::vector<struct mmsghdr> recvMsgs;
+    std::vector<struct iovec> recvIovs;
+    std::vector<struct sockaddr_storage> recvAddrs;
+
+    std::vector<std::string> outMsgs; // queued datagrams
+    std::vector<struct sockaddr_storage> outAddrs;
+    std::vector<socklen_t> outAddrLens;
+    std::chrono::steady_clock::time_point firstQueued;
+
+    long numReceived = 0, numRecvCalls = 0, numSent = 0, numSendCalls = 0;
+    long nextReport = UDP_REPORT_INTERVAL;
+
+public:
+    DatagramBatcher(int sockfd, size_t batchSize, size_t maxDatagram);
+
+
+    /**
+     * Receive up to a batch of datagrams with one recvmmsg call
+     * @param flags MSG_DONTWAIT to return at once if nothing is pending, MSG_WAITFORONE to block for the first one
+     * @return number of datagrams received, 0 if none is pending, -1 on errors
+     */
+    int receive(int flags);
+
+
+    /**
+     * @param i index of a datagram of the last receive()
+     * @return the datagram
+     */
+    std::string_view datagram(int i) const {
+        return std::string_view(&recvBuf[i * (maxDatagram + 1)], recvMsgs[i].msg_len);
+    }
+
+    /**
+     * @param i index of a datagram of the last receive()
+     * @return its sender's address
+     */
+    const struct sockaddr_storage& sender(int i) const {
+        return recvAddrs[i];
+    }
+
+    /**
+     * @param i index of a datagram of the last receive()
+     * @return length of its sender's address
+     */
+    socklen_t senderLen(int i) const {
+        return recvMsgs[i].msg_hdr.msg_namelen;
+    }
+
+
+    /**
+     * Queue a datagram; the queue is flushed when it holds a full batch
+     * @param msg the datagram
+     * @param addr destination address
+     * @param addrLen length of the destination address
+     * @return whether successful or not
+     */
+    bool queue(const std::string& msg, const struct sockaddr *addr, socklen_t addrLen);
+
+
+    /**
+     * Send all queued datagrams, a batch per sendmmsg call
+     * @return whether successful or not; datagrams the kernel has no buffer space for are dropped
+     */
+    bool flush();
+
+
+    /**
+     * @return number of queued datagrams
+     */
+    size_t numQueued() const {
+        return outMsgs.size();
+    }
+
+    /**
+     * @return when the oldest queued datagram was queued
+     */
+    std::chrono::steady_clock::time_point oldestQueued() const {
+        return firstQueued;
+    }
+
+    size_t getBatchSize() const {
+        return batchSize;
+    }
+
+
+    /**
+     * Whether the counters are due to be printed; true once every UDP_REPORT_INTERVAL received datagrams
+     */
+    bool reportDue();
+
+
+    /**
+     * @return the counters as a printable string
+     */
+    std::string statsStr() const;
+};
+
+
+// rooms a backend server holds for a prepared group reservation, until it is committed, aborted or expires
+struct RoomHold {
+    std::vector<uint32_t> roomIds;
+    std::chrono::steady_clock::time_point deadline;
+    struct sockaddr_storage addr; // where to push the updates when the hold is released
+    socklen_t addrLen;
+};
+
+
+// replication progress of a replica backend server
+struct ReplicaState {
+    std::vector<uint64_t> roomVersions; // ID: replication version of the count last applied
+    std::vector<bool> chunksReceived; // chunks of the current sync applied so far
+    size_t numChunksReceived = 0;
+    size_t syncRequestedFrom = 0; // first chunk of the window last asked for
+    uint64_t syncVersion = UINT64_MAX; // lowest replication version of the chunks of the current sync
+    bool synced = false; // a whole sync has been applied
+    uint64_t applied = 0; // every update up to this version has been applied, or was older than a sync
+    std::set<uint64_t> appliedAhead; // versions applied past a missing one
+    uint64_t latest = 0; // latest version the primary announced
+    long delayUs = 0; // how long the last update took from the primary until it was applied
+    std::chrono::steady_clock::time_point appliedAt; // when applied last advanced
+    std::chrono::steady_clock::time_point syncStart, nextSyncRequest, nextReport;
+    long lastReportedBehind = -1;
+};
+
+
 class BackendServer {
 private:
-    std::map<std::string, int> roomData; // stores room availability data
+    // The room table does not change shape once loaded, so workers look rooms up without locking. Counts are read
+    // atomically (CH) and changed with atomic read-modify-writes (RE: compare-and-swap decrement-if-positive).
+    RoomIndex roomData; // stores room availability data
+    RoomIndex inventory; // the room table as last read from the input file (or its room table file), for reloads
+    std::mutex recentLock; // guards recentReplies and recentRequestIds
+    std::unordered_map<std::string, std::string> recentReplies; // request ID: reply ("" while being handled)
+    std::deque<std::string> recentRequestIds; // eviction order of recentReplies
+    std::atomic<uint64_t> updateVersion{0}; // number of room status updates pushed to the main server
+    size_t batchSize = UDP_BATCH_SIZE;
+    long flushLatencyUs = UDP_FLUSH_LATENCY_US;
+    int numWorkers = BACKEND_WORKERS;
+    std::vector<std::unique_ptr<DatagramBatcher>> batchers; // batched I/O of each worker, created by bootup()
+    std::mutex holdLock; // guards holds and holdExpiry
+    std::unordered_map<std::string, struct RoomHold> holds; // transaction ID: held rooms
+    // (deadline, transaction ID) of holds in the order they were taken; since every hold lasts HOLD_LEASE_MS,
+    // this is also deadline order. Committed and aborted holds are skipped when they reach the front.
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> holdExpiry;
+    std::string dataFile; // input file the room data was loaded from, read again on RELOAD_SIGNAL
+    std::string logPath; // path prefix of the write-ahead log (.wal) and snapshot (.snap); empty if not durable
+    long fsyncIntervalMs = WAL_FSYNC_INTERVAL_MS;
+    long snapshotRecords = SNAPSHOT_RECORDS;
+    std::mutex logLock; // guards wal
+    std::unique_ptr<WriteAheadLog> wal; // created by loadData() if logPath is set
+    // held shared by workers while they handle requests, exclusively while a snapshot is taken or a reloaded
+    // room table is put in place
+    std::shared_mutex tableLock;
 
     std::string hostAddress;
     std::string port_UDP; // port number
     int sockfd_UDP; // socket file descripter
 
     struct addrinfo * SMinfo{}; // store the main server's info
-    std::string serverName; // the name of this backend server (S/D/U)
+    std::string serverName; // the name of this backend server (S/D/U, or a shard name such as S2)
+    ShardMap shardMap; // all backend servers; with several of this building type, this one serves its share only
+
+    // Replication: a primary streams every changed count, numbered by replicationVersion, to its replicas, which
+    // answer availability checks. A replica first fetches the whole room data in chunks (sync), then applies a
+    // count only if its version is newer than the last one applied to that room, so lost and reordered updates
+    // never roll a count back; an update missing for REPLICA_RESYNC_MS makes it sync again.
+    std::string primaryName; // name of the backend server this one replicates; empty for a primary
+    std::vector<std::pair<struct sockaddr_storage, socklen_t>> replicaAddrs; // replicas of this primary
+    struct sockaddr_storage primaryAddr; // address of the primary of this replica
+    socklen_t primaryAddrLen = 0;
+    std::atomic<uint64_t> replicationVersion{0}; // number of count changes streamed to the replicas
+    std::vector<uint32_t> syncChunkStarts; // first room ID of each sync chunk, plus the number of rooms
+    std::mutex replicaLock; // guards replica and nextReplicationTick
+    struct ReplicaState replica;
+    std::chrono::steady_clock::time_point nextReplicationTick;
+
+    void keepOwnedRooms(RoomIndex& rooms) const;
+    std::string readInventory(RoomIndex& rooms) const;
+    std::vector<uint32_t> syncChunksOf(const RoomIndex& rooms) const;
+    bool saveSnapshot();
 
 
 
@@ -126,12 +485,106 @@ public:
 
 
     /**
-     * Read from input file, store data into roomData
+     * Read from input file, store data into roomData.
+     * The file is memory-mapped and split at line boundaries into chunks that are scanned in parallel.
      * @param file: input file path + name
      */
     void initDataFromFile(const std::string& file);
 
 
+    /**
+     * Use a room table file as roomData, memory-mapped; startup time does not depend on the number of rooms
+     * @param file room table file path + name
+     * @return whether successful; false if there is no valid room table file
+     */
+    bool initDataFromTable(const std::string& file);
+
+
+    /**
+     * Write roomData as a room table file
+     * @param file room table file path + name
+     * @return whether successful or not
+     */
+    bool writeDataToTable(const std::string& file) const;
+
+
+    /**
+     * Keep room counts across restarts: log every reservation to a write-ahead log, and snapshot the room data
+     * every snapshotRecords log records; call before loadData()
+     * @param path path prefix of the log (path + ".wal") and the snapshot (path + ".snap")
+     * @param fsyncIntervalMs 0: fdatasync the log before each batch of replies, > 0: at most every this many ms, < 0: never
+     * @param snapshotRecords log records after which to take a snapshot
+     */
+    void enableLog(const std::string& path, long fsyncIntervalMs, long snapshotRecords);
+
+
+    /**
+     * Set the backend servers sharing the building type, and the replicas of this one or its primary; call before
+     * loadData()
+     * @param shards all backend servers, including this one
+     * @return whether successful; false if the address of a replica or the primary cannot be resolved
+     */
+    bool setShards(const ShardMap& shards);
+
+
+    /**
+     * @return whether this backend server is a replica, which gets its room data from its primary instead of
+     * sending it to the main server
+     */
+    bool isReplica() const;
+
+
+    /**
+     * Load the room data: from the snapshot and the write-ahead log if there is a snapshot, otherwise from the
+     * room table file next to the input file (e.g. single.rtab for single.txt) or else the input file itself
+     * (with a write-ahead log, the first snapshot is then taken right away). Of the room table or input file, only
+     * the room layouts this shard serves are kept.
+     * @param file input file path + name
+     * @return whether successful or not
+     */
+    bool loadData(const std::string& file);
+
+
+    /**
+     * Read the input file (or its room table file, unless the input file is newer) again and apply what changed
+     * since it was last read: room layouts are added and removed, and a count changed in the file changes the live
+     * count by as much, so reservations and holds are kept. The new room table is built while workers keep serving
+     * the current one, then swapped in under the table lock, which only waits for the requests being handled, the
+     * counts to be copied and the holds to be moved. Changed counts are pushed to the main server (removed room
+     * layouts as 0) and the replicas; with a write-ahead log the changes are logged, as reservations are. A replica
+     * syncs its counts from its primary again.
+     * @return whether successful; false if the input file cannot be read, leaving the room data unchanged
+     */
+    bool reloadData();
+
+
+    /**
+     * Log a reservation of one room; it becomes durable with the next commitLog()
+     * @param id ID of the room layout
+     */
+    void logReservation(uint32_t id);
+
+
+    /**
+     * Write the reservations logged since the last call (group commit), and take a snapshot if the log is long enough
+     * @return whether successful or not
+     */
+    bool commitLog();
+
+
+    /**
+     * Snapshot the room data, counting held rooms as available (their holds are not logged), and empty the log
+     * @return whether successful or not
+     */
+    bool takeSnapshot();
+
+
+    /**
+     * @return number of room layouts in roomData
+     */
+    size_t numRooms() const;
+
+
     /**
      * Creat & bind a UDP socket
      * @return whether successful or not
@@ -149,19 +602,180 @@ public:
 
 
     /**
-     * Send the room data with the "INIT\n" header to the main server
-     * @return whether successful or not
+     * Largest INIT datagram that fits the path MTU towards the main server, without IP fragmentation
+     * @return datagram size in bytes
+     */
+    size_t initChunkSize() const;
+
+
+    /**
+     * Send the room data to the main server as a stream of sequenced INIT chunks, each sized to the path MTU.
+     * Up to INIT_WINDOW chunks (and INIT_WINDOW_BYTES) are unacknowledged at a time; a chunk not acknowledged within INIT_RETRANSMIT_MS
+     * is sent again.
+     * @return whether successful or not; fails if the main server acknowledges nothing for INIT_MAX_RETRIES rounds
+     */
+    bool sendInitDataToMainServer();
+
+    /**
+     * Set how requests and replies are batched; call before bootup()
+     * @param batchSize max datagrams per recvmmsg/sendmmsg call
+     * @param flushLatencyUs max time a reply waits for more requests to share its sendmmsg call
+     */
+    void setBatching(size_t batchSize, long flushLatencyUs);
+
+
+    /**
+     * Set the number of worker threads, which all receive requests from the UDP port; call before bootup()
+     * @param numWorkers number of worker threads
+     */
+    void setWorkers(int numWorkers);
+
+
+    /**
+     * Push a changed room status to the main server, so its cache of all room data stays coherent.
+     * Updates are numbered, so the main server can tell lost and reordered updates; the count is read after the
+     * update is numbered, so of two updates of a room layout the later numbered one has the later count.
+     * @param roomcode room layout code
+     * @param id ID of the room layout, or ROOM_NOT_FOUND if it has been removed (pushed as 0 available)
+     * @param addr address of the main server's socket the request came from
+     * @param addrLen length of addr
+     * @param batcher batcher of the worker to send with
+     */
+    void pushUpdate(const std::string& roomcode, uint32_t id, const struct sockaddr *addr, socklen_t addrLen,
+                    DatagramBatcher& batcher);
+
+
+    /**
+     * Stream the count of a room layout to the replicas, numbered with the next replication version
+     * @param id ID of the room layout
+     * @param batcher batcher of the worker to send with
+     */
+    void replicate(uint32_t id, DatagramBatcher& batcher);
+
+
+    /**
+     * Send a window of sync chunks to a replica: "SYNC_R\n(version)\n(seq)\n(total)\n(room_data_entries)", the
+     * version being the replication version before the counts were read
+     * @param firstChunk first chunk the replica is missing
+     * @param addr address of the replica
+     * @param addrLen length of addr
+     * @param batcher batcher of the worker to send with
+     */
+    void sendSyncChunks(size_t firstChunk, const struct sockaddr *addr, socklen_t addrLen, DatagramBatcher& batcher);
+
+
+    /**
+     * Apply an update ("REP\n(version)\n(sent at)\n(roomcode),(num_available)", or without the last line when the
+     * primary only announces its version) or a sync chunk from the primary; replica only
+     * @param op MSG_REPLICATE or MSG_SYNC_CHUNK
+     * @param iss the message, after its op code line
+     * @param batcher batcher of the worker to send with
+     */
+    void applyReplication(const std::string& op, std::istringstream& iss, DatagramBatcher& batcher);
+
+
+    /**
+     * Ask the primary for the next window of sync chunks; call with replicaLock held
+     * @param batcher batcher of the worker to send with
+     */
+    void requestSync(DatagramBatcher& batcher);
+
+
+    /**
+     * Periodic replication work, every REPLICA_HEARTBEAT_MS: a primary announces its latest version to its replicas;
+     * a replica asks again for sync chunks that did not arrive, syncs again if an update has been missing for too
+     * long, and reports its lag to the main server: "LAG\n(updates behind)\n(delay of the last update in us)\n(synced)"
+     * @param batcher batcher of the worker to send with
+     */
+    void replicationTick(DatagramBatcher& batcher);
+
+
+    /**
+     * Check the availability of one room layout, without taking any lock
+     * @param roomcode room layout code
+     * @param id to store the ID of the room layout, or ROOM_NOT_FOUND
+     * @return result op code: MSG_CHECK_AVAILABLE, MSG_CHECK_UNAVAILABLE or MSG_CHECK_NOTFOUND
+     */
+    std::string checkRoom(const std::string& roomcode, uint32_t& id);
+
+
+    /**
+     * Reserve one room of a room layout with a lock-free decrement-if-positive
+     * @param roomcode room layout code
+     * @param id to store the ID of the room layout, or ROOM_NOT_FOUND
+     * @return result op code: MSG_RESERVE_SUCCEED, MSG_RESERVE_FAIL or MSG_RESERVE_NOTFOUND
+     */
+    std::string reserveRoom(const std::string& roomcode, uint32_t& id);
+
+
+    /**
+     * Prepare a group reservation: hold one room of each room layout until the main server commits or aborts.
+     * If any room cannot be held, none is.
+     * @param txid transaction ID
+     * @param roomcodes room layout codes
+     * @param addr address of the main server's socket the request came from
+     * @param addrLen length of addr
+     * @return one "(result op code),(num_available)" line per room layout, num_available being -1 for unknown ones
+     */
+    std::string prepareHold(const std::string& txid, const std::vector<std::string>& roomcodes,
+                            const struct sockaddr *addr, socklen_t addrLen);
+
+
+    /**
+     * Give the rooms of a hold back and push their counts to the main server
+     * @param txid transaction ID of the hold
+     * @param batcher batcher of the worker to send with
      */
-    bool sendInitDataToMainServer() const;
+    void releaseHold(const std::string& txid, DatagramBatcher& batcher);
+
 
     /**
-      * recvfrom the main server over the UDP port, and react accordingly.
+     * Release the holds whose lease has expired
+     * @param batcher batcher of the worker to send with
+     */
+    void expireHolds(DatagramBatcher& batcher);
+
+
+    /**
+     * Handle one request of the main server, and queue the reply
+     * @param msg the request
+     * @param addr address of the main server's socket the request came from
+     * @param addrLen length of addr
+     * @param batcher batcher of the worker to reply with
+     */
+    void handleRequest(const std::string& msg, const struct sockaddr *addr, socklen_t addrLen, DatagramBatcher& batcher);
+
+
+    /**
+      * Receive a batch of requests from the main server over the UDP port, and react accordingly.
+      * Replies are sent together once no more requests arrive within the flush latency, or the batch is full.
+      * @param worker index of the calling worker thread
       */
-    void handleMainServer();
+    void handleMainServer(int worker);
+
+
+    /**
+     * Run the worker threads, each receiving requests from the shared UDP socket; the calling thread is worker 0.
+     * The room data is reloaded whenever the process gets RELOAD_SIGNAL.
+     * Never returns.
+     */
+    void run();
 
 
 };
 
 
+/**
+ * Start a backend server of a building type: read its command line options (see server_utils.cpp), look it up in
+ * the backends configuration file, load its room data, send it to the main server and serve requests
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ * @param buildingType building type the server must serve, e.g. 'S'; also its default name
+ * @param inputFile text room inventory of the building type, e.g. "single.txt"
+ * @return exit status if the server could not start; never returns otherwise
+ */
+int runBackendMain(int argc, char *argv[], char buildingType, const std::string& inputFile);
+
+
 
 #endif //SERVERUTILS_H
@@ -0,0 +1,138 @@
+#include "shard_map.h"
+#include "server_utils.h"
+
+
+/**
+ * Hash of a room code or ring point: FNV-1a, then a final mix so that keys differing in their last characters
+ * (S0001, S0002, ...) spread over the whole ring
+ * @param key room code, or "(shard name)#(point number)"
+ * @return hash
+ */
+uint32_t ShardMap::hashOf(std::string_view key) {
+    uint32_t hash = 2166136261u;
+    for (char c : key) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+/**
+ * Add a backend server; a primary gets its points on the ring of its building type
+ * @param shard the backend server
+ * @return whether successful; false if the name is taken
+ */
+bool ShardMap::add(const BackendShard& shard) {
+    if (find(shard.name) != nullptr) {
+        return false;
+    }
+    if (!shard.primary.empty()) { // replicas are not on the ring
+        shards.push_back(shard);
+        return true;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>>& ring = rings[shard.buildingType];
+    for (int i = 0; i < SHARD_VIRTUAL_NODES; i++) {
+        ring.emplace_back(hashOf(shard.name + "#" + std::to_string(i)), shards.size());
+    }
+    std::sort(ring.begin(), ring.end());
+    shards.push_back(shard);
+    return true;
+}
+
+
+bool ShardMap::load(const std::string& path) {
+    std::ifstream inFile(path);
+    if (!inFile) {
+        std::istringstream defaults(
+            "S S " LOCAL_HOST " " PORT_SS_UDP "\n"
+            "D D " LOCAL_HOST " " PORT_SD_UDP "\n"
+            "U U " LOCAL_HOST " " PORT_SU_UDP "\n");
+        return parse(defaults, "default backends");
+    }
+    return parse(inFile, path);
+}
+
+
+bool ShardMap::parse(std::istream& in, const std::string& source) {
+    std::string line;
+    int lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        std::istringstream iss(line);
+        struct BackendShard shard;
+        std::string buildingType, extra;
+        if (!(iss >> shard.name) || shard.name[0] == '#') { // blank line or comment
+            continue;
+        }
+        if (!(iss >> buildingType >> shard.hostAddress >> shard.port) || (iss >> shard.primary && iss >> extra) ||
+            buildingType.length() != 1 || atoi(shard.port.c_str()) <= 0) {
+            std::cerr << source << ":" << lineNumber << ": expected \"<name> <building type> <host address> <UDP port>"
+                " [<primary name>]\"" << std::endl;
+            return false;
+        }
+        shard.buildingType = buildingType[0];
+        const BackendShard *primary = shard.primary.empty() ? nullptr : find(shard.primary);
+        if (!shard.primary.empty() && (primary == nullptr || !primary->primary.empty() ||
+            primary->buildingType != shard.buildingType)) {
+            std::cerr << source << ":" << lineNumber << ": " << shard.primary << " is not a primary backend server of"
+                " building type " << shard.buildingType << " listed before " << shard.name << std::endl;
+            return false;
+        }
+        if (!add(shard)) {
+            std::cerr << source << ":" << lineNumber << ": duplicate backend server name " << shard.name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+const std::string& ShardMap::route(std::string_view roomcode) const {
+    static const std::string none;
+    if (roomcode.empty()) {
+        return none;
+    }
+    auto ring = rings.find(roomcode[0]);
+    if (ring == rings.end()) {
+        return none;
+    }
+    // the first point at or after the hash, wrapping around past the last point
+    auto point = std::lower_bound(ring->second.begin(), ring->second.end(),
+                                  std::make_pair(hashOf(roomcode), (uint32_t)0));
+    if (point == ring->second.end()) {
+        point = ring->second.begin();
+    }
+    return shards[point->second].name;
+}
+
+
+const BackendShard *ShardMap::find(const std::string& name) const {
+    for (const BackendShard& shard : shards) {
+        if (shard.name == name) {
+            return &shard;
+        }
+    }
+    return nullptr;
+}
+
+
+std::vector<const BackendShard *> ShardMap::replicasOf(const std::string& name) const {
+    std::vector<const BackendShard *> replicas;
+    for (const BackendShard& shard : shards) {
+        if (shard.primary == name) {
+            replicas.push_back(&shard);
+        }
+    }
+    return replicas;
+}
+
+
+size_t ShardMap::numShardsOf(char buildingType) const {
+    auto ring = rings.find(buildingType);
+    return ring == rings.end() ? 0 : ring->second.size() / SHARD_VIRTUAL_NODES;
+}
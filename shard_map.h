@@ -0,0 +1,104 @@
+#ifndef SHARDMAP_H
+#define SHARDMAP_H
+
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <istream>
+#include <cstdint>
+
+
+// Which backend server instance serves a room layout. Every building type (the first letter of a room code: S, D
+// or U) is served by one or more backend servers, its shards, each owning a part of the room codes. The shards of
+// a building type are placed on a hash ring by consistent hashing: each shard takes SHARD_VIRTUAL_NODES points on
+// the ring, and a room code belongs to the shard of the first point at or after the room code's hash. Adding a
+// shard only moves the room codes that now fall just before its points, about 1/(number of shards) of them.
+//
+// The backends are listed in a configuration file, one per line (blank lines and lines starting with '#' are
+// skipped):
+//   <name> <building type> <host address> <UDP port> [<primary name>]
+// e.g. "S2 S 127.0.0.1 41912". Names are unique; they name the shard in messages and its log files.
+// A line with a primary name, listed after that primary, is a replica: it is not on the ring, but gets the
+// primary's room data and answers availability checks of the primary's room layouts.
+// Without a configuration file, the building types S, D and U are served by one backend server each.
+#define BACKENDS_CONF "backends.conf"
+#define SHARD_VIRTUAL_NODES 128
+
+
+// one backend server instance
+struct BackendShard {
+    std::string name; // e.g. "S", or "S1", "S2", ... for several shards of one building type
+    char buildingType; // first letter of the room codes it serves
+    std::string hostAddress;
+    std::string port; // UDP port
+    std::string primary; // name of the backend server this one replicates, "" if it is a primary
+};
+
+
+class ShardMap {
+private:
+    std::vector<BackendShard> shards;
+    // building type: its hash ring, (point, index into shards) sorted by point
+    std::map<char, std::vector<std::pair<uint32_t, uint32_t>>> rings;
+
+    static uint32_t hashOf(std::string_view key);
+    bool add(const BackendShard& shard);
+
+public:
+    /**
+     * Read the backends from a configuration file; the default backends if there is no such file
+     * @param path configuration file path
+     * @return whether successful; false if the file has a malformed line or a duplicate name
+     */
+    bool load(const std::string& path);
+
+
+    /**
+     * Read the backends from configuration lines
+     * @param in configuration lines
+     * @param source name of the input in error messages
+     * @return whether successful; false if there is a malformed line or a duplicate name
+     */
+    bool parse(std::istream& in, const std::string& source);
+
+
+    /**
+     * @param roomcode room layout code
+     * @return name of the backend server that serves the room layout, or "" if none serves its building type
+     */
+    const std::string& route(std::string_view roomcode) const;
+
+
+    /**
+     * @param name backend server name
+     * @return the backend server, or nullptr if there is none with this name
+     */
+    const BackendShard *find(const std::string& name) const;
+
+
+    /**
+     * @param name name of a primary backend server
+     * @return its replicas, in configuration order
+     */
+    std::vector<const BackendShard *> replicasOf(const std::string& name) const;
+
+
+    /**
+     * @param buildingType building type
+     * @return number of primary backend servers serving the building type
+     */
+    size_t numShardsOf(char buildingType) const;
+
+
+    /**
+     * @return all backend servers, in configuration order
+     */
+    const std::vector<BackendShard>& all() const {
+        return shards;
+    }
+};
+
+
+#endif //SHARDMAP_H